@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "utils_v3.h"
+#include "pascman.h"
+#include "game.h"
+#include "sink.h"
+#include "cmdqueue.h"
+#include "bitboard.h"
+#include "bot.h"
+
+// ********************************************************************************
+// BENCHMARK DU COEUR DU JEU
+// ================================================================================
+// Ce programme charge chaque map donnée en argument avec load_map, puis fait
+// jouer tous les joueurs de la map (state.nb_players, à tour de role) au hasard
+// (une suite de directions pseudo-aléatoires, reproductible grace à la graine)
+// en appelant process_user_command. Quand une partie se termine, elle
+// recommence aussitot (meme au milieu d'un lot) depuis l'état initial de la
+// map: aucune commande ne tombe sur une partie terminée.
+//
+// Six modes sont mesurés pour chaque map:
+// - "immediate": chaque commande est traitée et envoyée seule sur /dev/null (un
+//   write par commande qui génère des messages), comme le fait process_user_command.
+// - "batched":   les commandes sont traitées par lots de CMDQ_MAX_BATCH dont
+//   les messages partent en un seul write sur /dev/null (cf. cmdq_apply).
+// - "null":      les messages sont comptés mais pas encodés (cf. SINK_NULL):
+//   c'est le cout du coeur du jeu seul.
+// - "bitboard":  idem "null", mais sur une BitGameState (cf. bitboard.h) plutot
+//   que sur une GameState.
+// - "table":     idem "null", mais la destination de chaque déplacement est lue
+//   dans la table des déplacements de la map (cf. process_user_command_table_into).
+// - "bots":      idem "table", mais les commandes sont choisies par les bots
+//   (cf. bot.h) plutot qu'au hasard: c'est le cout d'un bot par commande.
+//
+// Le résultat est écrit sur la sortie standard, une ligne JSON par map et par
+// mode, pour pouvoir etre comparé d'une version à l'autre:
+//
+//   {"bench":"game","map":"resources/map.txt","mode":"immediate","moves":...,
+//    "games":...,"seconds":...,"moves_per_sec":...,"ns_per_move":...,
+//    "messages":...,"bytes":...,"syscalls":...}
+//
+// Usage: ./bench_game [-n moves] [-s seed] resources/map*.txt
+// ********************************************************************************
+
+#define DEFAULT_MOVES 2000000
+#define DEFAULT_SEED  42
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Un générateur pseudo-aléatoire (xorshift64) rapide et reproductible:
+// rand() couterait plus cher que ce qu'on veut mesurer.
+static uint64_t next_random(uint64_t *seed) {
+    uint64_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *seed = x;
+}
+
+// Remplit 'cmds' avec 'count' commandes aléatoires (les 'nb_players' joueurs
+// jouent à tour de role).
+static void random_commands(struct Command *cmds, size_t count, uint32_t nb_players, uint64_t *seed) {
+    for (size_t i = 0; i < count; i++) {
+        cmds[i].player    = PLAYER_ITEM(i % nb_players);
+        cmds[i].dir       = (enum Direction) (next_random(seed) % 4);
+        cmds[i].timestamp = 0;
+    }
+}
+
+// Fait jouer 'moves' commandes aléatoires sur la map 'initial' et affiche le résultat.
+static void run(const char *path, const char *mode, const struct GameState *initial,
+                const struct MoveTable *table, size_t moves, uint64_t seed, FileDescriptor devnull) {
+    bool batched     = strcmp(mode, "batched") == 0;
+    bool bitboard    = strcmp(mode, "bitboard") == 0;
+    bool use_table   = strcmp(mode, "table") == 0;
+    bool bots        = strcmp(mode, "bots") == 0;
+    bool null        = strcmp(mode, "null") == 0 || bitboard || use_table || bots;
+    struct Sink sink = null ? sink_null() : sink_fd(devnull);
+    struct GameState state;
+    copy_gamestate(&state, initial);
+    struct BitGameState *bb_initial = bb_new(initial);
+    struct BitGameState *bb         = bb_new(initial);
+    // (statiques: trop grandes pour la pile avec de très grandes maps, cf. MAX_WIDTH)
+    static struct FoodField field_initial, field;
+    food_field_build(&field_initial, initial, table);
+    field = field_initial;
+    struct Command cmds[CMDQ_MAX_BATCH];
+    size_t games = 1;
+
+    struct BroadcastStats before = total_broadcast_stats();
+    double start = now_sec();
+    for (size_t done = 0; done < moves; done += CMDQ_MAX_BATCH) {
+        size_t count = moves - done < CMDQ_MAX_BATCH ? moves - done : CMDQ_MAX_BATCH;
+        random_commands(cmds, count, initial->nb_players, &seed);
+
+        if (batched) {
+            // comme cmdq_apply: les messages du lot partent d'un coup (mais la
+            // partie recommence dès qu'elle se termine, pas en fin de lot)
+            sink.deferred = true;
+        }
+        for (size_t i = 0; i < count; i++) {
+            bool over;
+            if (bots) {
+                over = bot_play_into(&state, table, &field, cmds[i].player, &sink);
+            } else if (use_table) {
+                over = process_user_command_table_into(&state, table, cmds[i].player, cmds[i].dir, &sink);
+            } else if (bitboard) {
+                over = bb_process_command_into(bb, cmds[i].player, cmds[i].dir, &sink);
+            } else {
+                over = process_user_command_into(&state, cmds[i].player, cmds[i].dir, &sink);
+            }
+            if (over) {
+                // la partie recommence tout de suite: les commandes suivantes
+                // ne tombent pas sur une partie terminée
+                copy_gamestate(&state, initial);
+                bb_copy(bb, bb_initial);
+                field = field_initial;
+                games++;
+            }
+        }
+        if (batched) {
+            sink.deferred = false;
+            flush_sink(&sink);
+        }
+    }
+    double seconds = now_sec() - start;
+    struct BroadcastStats after = total_broadcast_stats();
+
+    printf("{\"bench\":\"game\",\"map\":\"%s\",\"mode\":\"%s\",\"moves\":%zu,\"games\":%zu,"
+           "\"seconds\":%.6f,\"moves_per_sec\":%.0f,\"ns_per_move\":%.2f,"
+           "\"messages\":%zu,\"bytes\":%zu,\"syscalls\":%zu}\n",
+           path, mode, moves, games, seconds, moves / seconds, seconds * 1e9 / moves,
+           after.messages - before.messages, after.bytes - before.bytes,
+           after.syscalls - before.syscalls);
+
+    free(bb_initial);
+    free(bb);
+}
+
+int main(int argc, char **argv) {
+    size_t moves  = DEFAULT_MOVES;
+    uint64_t seed = DEFAULT_SEED;
+    int first     = 1;
+    while (first + 1 < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-n") == 0) {
+            moves = strtoul(argv[first + 1], NULL, 10);
+        } else if (strcmp(argv[first], "-s") == 0) {
+            seed = strtoull(argv[first + 1], NULL, 10);
+        } else {
+            break;
+        }
+        first += 2;
+    }
+    if (first >= argc || moves == 0 || seed == 0) {
+        fprintf(stderr, "usage: %s [-n moves] [-s seed] map.txt...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FileDescriptor devnull = sopen("/dev/null", O_WRONLY, 0);
+    for (int i = first; i < argc; i++) {
+        struct GameState initial;
+        static struct MoveTable table;
+        FileDescriptor fdmap = sopen(argv[i], O_RDONLY, 0);
+        load_map(fdmap, devnull, &initial);
+        sclose(fdmap);
+        build_move_table(&initial, &table);
+
+        run(argv[i], "immediate", &initial, &table, moves, seed, devnull);
+        run(argv[i], "batched", &initial, &table, moves, seed, devnull);
+        run(argv[i], "null", &initial, &table, moves, seed, devnull);
+        run(argv[i], "bitboard", &initial, &table, moves, seed, devnull);
+        run(argv[i], "table", &initial, &table, moves, seed, devnull);
+        run(argv[i], "bots", &initial, &table, moves, seed, devnull);
+    }
+    sclose(devnull);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "utils_v3.h"
+#include "pascman.h"
+#include "game.h"
+
+// ********************************************************************************
+// MICROBENCHMARK DU CHARGEMENT DES MAPS
+// ================================================================================
+// Ce programme compare l'ancienne facon de charger une map (un appel a read par
+// caractere du fichier, avec le parseur d'origine) avec load_map qui lit tout
+// le fichier en une fois. Pour chaque map, il verifie d'abord que les deux
+// methodes donnent exactement la meme GameState et la meme map, puis il mesure
+// le temps moyen d'un chargement complet (ouverture du fichier comprise).
+//
+// Usage: ./bench_load_map [-n iterations] resources/map*.txt
+// ********************************************************************************
+
+#define DEFAULT_ITERATIONS 2000
+
+// L'ancien chargement (copie du parseur d'origine): le fichier est lu et
+// interprete caractere par caractere. Seuls les SPAWN envoyes pour chaque case
+// ont ete retires (ce format n'existe plus): la map est envoyee ensuite par
+// send_map, comme le fait load_map.
+static void legacy_load_map(FileDescriptor fdmap, FileDescriptor fdbcast, struct GameState *state) {
+    reset_gamestate(state);
+
+    size_t pos  = 0;
+    uint32_t x  = 0;
+    uint32_t y  = 0;
+    char c      = '\0';
+    while(sread(fdmap, &c, sizeof(char)) > 0) {
+        switch (c) {
+            case '#': 
+                state->map[pos] = WALL;
+                x++;
+                pos++;
+                break;
+            case '.':
+                state->map[pos] = FOOD;
+                state->food_count++;
+                x++;
+                pos++;
+                break;
+            case '*':
+                state->map[pos] = SUPERFOOD;
+                state->food_count++;
+                x++;
+                pos++;
+                break;
+            case ' ':
+                state->map[pos] = FLOOR;
+                x++;
+                pos++;
+                break;
+            case '@':
+                state->map[pos] = FLOOR;
+                state->positions[0].x = x;
+                state->positions[0].y = y;
+                x++;
+                pos++;
+                break;
+            case '!':
+                state->map[pos] = FLOOR;
+                state->positions[1].x = x;
+                state->positions[1].y = y;
+                x++;
+                pos++;
+                break;
+            case '\n':
+                y ++;
+                x = 0;
+                break;
+            default:
+                // par défaut on ne fait simplement rien
+                break;
+        }
+    }
+
+    if (state->food_count == 0) {
+        state->game_over = true;
+    } else {
+        state->game_over = false;
+    }
+    send_map(state, fdbcast);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Charge la map 'path' avec 'loader' et renvoie le flux de messages généré.
+static char *capture(const char *path,
+                     void (*loader)(FileDescriptor, FileDescriptor, struct GameState *),
+                     struct GameState *state, size_t *len) {
+    char tmpl[] = "/tmp/bench_load_map_XXXXXX";
+    FileDescriptor out = mkstemp(tmpl);
+    checkNeg(out, "Error MKSTEMP");
+    unlink(tmpl);
+
+    FileDescriptor fdmap = sopen(path, O_RDONLY, 0);
+    loader(fdmap, out, state);
+    sclose(fdmap);
+
+    lseek(out, 0, SEEK_SET);
+    char *stream = readFileToBuffer(out, len);
+    sclose(out);
+    return stream;
+}
+
+static bool same_state(const struct GameState *a, const struct GameState *b) {
+    return a->width == b->width && a->height == b->height && a->nb_players == b->nb_players
+        && memcmp(a->map, b->map, map_cells(a)) == 0
+        && memcmp(a->scores, b->scores, a->nb_players * sizeof(int)) == 0
+        && memcmp(a->positions, b->positions, a->nb_players * sizeof(struct Position)) == 0
+        && a->food_count == b->food_count
+        && a->game_over == b->game_over;
+}
+
+// Temps moyen (en ns) d'un chargement de la map 'path' avec 'loader'.
+static double time_loader(const char *path, int iterations,
+                          void (*loader)(FileDescriptor, FileDescriptor, struct GameState *),
+                          FileDescriptor devnull, struct GameState *state) {
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        FileDescriptor fdmap = sopen(path, O_RDONLY, 0);
+        loader(fdmap, devnull, state);
+        sclose(fdmap);
+    }
+    return (now_ns() - start) / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = DEFAULT_ITERATIONS;
+    int first      = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atoi(argv[2]);
+        first      = 3;
+    }
+    if (first >= argc || iterations <= 0) {
+        fprintf(stderr, "usage: %s [-n iterations] map.txt...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FileDescriptor devnull = sopen("/dev/null", O_WRONLY, 0);
+    struct GameState legacy_state, state;
+
+    printf("%-28s %12s %12s %8s\n", "map", "legacy (ns)", "whole (ns)", "speedup");
+    for (int i = first; i < argc; i++) {
+        const char *path = argv[i];
+
+        size_t legacy_len, len;
+        char *legacy_stream = capture(path, legacy_load_map, &legacy_state, &legacy_len);
+        char *stream        = capture(path, load_map, &state, &len);
+        // load_map envoie la meme map, puis les joueurs
+        bool same = legacy_len <= len
+                 && memcmp(legacy_stream, stream, legacy_len) == 0
+                 && same_state(&legacy_state, &state);
+        free(legacy_stream);
+        free(stream);
+        if (!same) {
+            fprintf(stderr, "%s: the two loaders disagree\n", path);
+            return EXIT_FAILURE;
+        }
+
+        double legacy_ns = time_loader(path, iterations, legacy_load_map, devnull, &legacy_state);
+        double whole_ns  = time_loader(path, iterations, load_map, devnull, &state);
+        printf("%-28s %12.0f %12.0f %7.1fx\n", path, legacy_ns, whole_ns, legacy_ns / whole_ns);
+    }
+
+    sclose(devnull);
+    return EXIT_SUCCESS;
+}
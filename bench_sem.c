@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "utils_v3.h"
+
+// ********************************************************************************
+// BENCHMARK DES SEMAPHORES
+// ================================================================================
+// Ce programme compare les sémaphores SysV (sem_down/sem_up, un appel système
+// semop à chaque opération) et les sémaphores futex (fsem_down/fsem_up, qui ne
+// font d'appel système que s'il faut s'endormir ou réveiller quelqu'un).
+//
+// Pour chaque backend et pour 1, 2 et 8 processus, chaque processus prend puis
+// rend 'iterations' fois un meme sémaphore initialisé à 1 (un verrou), en
+// incrémentant un compteur en mémoire partagée entre les deux. A la fin, le
+// compteur doit valoir 'processes' x 'iterations' (sinon le verrou n'a pas
+// fait son travail).
+//
+// Le résultat est écrit sur la sortie standard, une ligne JSON par backend et
+// par nombre de processus:
+//
+//   {"bench":"sem","backend":"sysv","processes":2,"iterations":...,
+//    "seconds":...,"ns_per_lock":...,"ok":true}
+//
+// où ns_per_lock est le temps moyen d'un couple down/up (tous processus confondus).
+//
+// Usage: ./bench_sem [-n iterations]
+// ********************************************************************************
+
+#define DEFAULT_ITERATIONS 200000
+
+// Les deux backends ont la meme API.
+struct Backend
+{
+    const char *name;
+    int  (*create)(key_t key, int nsems, int perm, int val);
+    void (*down)(int id, int sem_num);
+    void (*up)(int id, int sem_num);
+    void (*delete)(int id);
+};
+
+static const struct Backend BACKENDS[] = {
+    { "sysv",  sem_create,  sem_down,  sem_up,  sem_delete  },
+    { "futex", fsem_create, fsem_down, fsem_up, fsem_delete },
+};
+
+// Ce que chaque processus du benchmark doit faire.
+struct Worker
+{
+    const struct Backend *backend;
+    int sem_id;
+    long *counter;
+    size_t iterations;
+    // le processus attend que ce pipe soit fermé pour commencer
+    int start[2];
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Prend et rend le verrou 'iterations' fois.
+static void work(void *arg) {
+    const struct Worker *worker = arg;
+    char c;
+    sclose(worker->start[1]);
+    sread(worker->start[0], &c, 1);
+    for (size_t i = 0; i < worker->iterations; i++) {
+        worker->backend->down(worker->sem_id, 0);
+        (*worker->counter)++;
+        worker->backend->up(worker->sem_id, 0);
+    }
+}
+
+// Mesure le backend 'backend' avec 'processes' processus.
+static void run(const struct Backend *backend, int processes, size_t iterations) {
+    int shm_id    = sshmget(IPC_PRIVATE, sizeof(long), IPC_CREAT | 0600);
+    long *counter = sshmat(shm_id);
+    *counter      = 0;
+
+    struct Worker worker = {
+        .backend    = backend,
+        .sem_id     = backend->create(IPC_PRIVATE, 1, 0600, 1),
+        .counter    = counter,
+        .iterations = iterations
+    };
+    int *start = worker.start;
+    spipe(start);
+    // sinon les processus fils réécrivent ce qui est encore dans le buffer
+    fflush(stdout);
+    for (int i = 0; i < processes; i++) {
+        fork_and_run1(work, &worker);
+    }
+    sclose(start[0]);
+
+    // tous les processus commencent en meme temps: quand le pipe est fermé
+    double begin = now_sec();
+    sclose(start[1]);
+    for (int i = 0; i < processes; i++) {
+        swait(NULL);
+    }
+    double seconds = now_sec() - begin;
+
+    size_t locks = (size_t) processes * iterations;
+    printf("{\"bench\":\"sem\",\"backend\":\"%s\",\"processes\":%d,\"iterations\":%zu,"
+           "\"seconds\":%.6f,\"ns_per_lock\":%.2f,\"ok\":%s}\n",
+           backend->name, processes, iterations, seconds, seconds * 1e9 / locks,
+           *counter == (long) locks ? "true" : "false");
+
+    backend->delete(worker.sem_id);
+    sshmdt(counter);
+    sshmdelete(shm_id);
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = DEFAULT_ITERATIONS;
+    if (argc == 3 && strcmp(argv[1], "-n") == 0) {
+        iterations = strtoul(argv[2], NULL, 10);
+    } else if (argc != 1) {
+        iterations = 0;
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const int processes[] = { 1, 2, 8 };
+    for (size_t b = 0; b < sizeof(BACKENDS) / sizeof(BACKENDS[0]); b++) {
+        for (size_t p = 0; p < sizeof(processes) / sizeof(processes[0]); p++) {
+            run(&BACKENDS[b], processes[p], iterations);
+        }
+    }
+    return EXIT_SUCCESS;
+}
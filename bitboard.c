@@ -0,0 +1,211 @@
+#include <string.h>
+
+#include "utils_v3.h"
+
+#include "bitboard.h"
+
+// Cette fonction alloue une BitGameState pour l'état 'state'.
+struct BitGameState *bb_new(const struct GameState *state) {
+    struct BitGameState *bb = smalloc(bb_size_for(state->width, state->height, state->nb_players));
+    bb_from_state(bb, state);
+    return bb;
+}
+
+// Cette fonction copie 'src' dans 'dst'.
+void bb_copy(struct BitGameState *dst, const struct BitGameState *src) {
+    checkCond(bb_size(dst) != bb_size(src), "Error BB_COPY: states of different sizes");
+    memcpy(dst, src, bb_size(src));
+}
+
+// Cette fonction remplit 'bb' à partir de l'état 'state'.
+void bb_from_state(struct BitGameState *bb, const struct GameState *state) {
+    size_t size = bb_size_for(state->width, state->height, state->nb_players);
+    memset(bb, 0, size);
+    bb->width      = state->width;
+    bb->height     = state->height;
+    bb->words      = (map_cells(state) + 63) / 64;
+    bb->nb_players = state->nb_players;
+    uint64_t *walls     = bb_walls(bb);
+    uint64_t *food      = bb_food(bb);
+    uint64_t *superfood = bb_superfood(bb);
+    for (size_t i = 0; i < map_cells(state); i++) {
+        switch (state->map[i]) {
+        case FLOOR:
+            break;
+        case FOOD:
+            bb_set(food, i);
+            break;
+        case SUPERFOOD:
+            bb_set(superfood, i);
+            break;
+        default:
+            bb_set(walls, i);
+            break;
+        }
+    }
+    for (size_t i = 0; i < state->nb_players; i++) {
+        bb_player(bb, i)->score = state->scores[i];
+        bb_player(bb, i)->pos   = state->positions[i];
+        bb_set(bb_players(bb), map_index(state, state->positions[i]));
+    }
+    bb->food_left = (uint32_t) bb_food_count(bb);
+    bb->game_over = state->game_over;
+}
+
+// Cette fonction remplit 'state' à partir de l'état 'bb'.
+void bb_to_state(const struct BitGameState *bb, struct GameState *state) {
+    state->width  = bb->width;
+    state->height = bb->height;
+    for (size_t i = 0; i < map_cells(state); i++) {
+        if (bb_test(bb_walls(bb), i)) {
+            state->map[i] = WALL;
+        } else if (bb_test(bb_food(bb), i)) {
+            state->map[i] = FOOD;
+        } else if (bb_test(bb_superfood(bb), i)) {
+            state->map[i] = SUPERFOOD;
+        } else {
+            state->map[i] = FLOOR;
+        }
+    }
+    state->nb_players = bb->nb_players;
+    for (size_t i = 0; i < bb->nb_players; i++) {
+        state->scores[i]    = bb_player(bb, i)->score;
+        state->positions[i] = bb_player(bb, i)->pos;
+    }
+    memcpy(state->occupied, bb_players(bb), bb->words * sizeof(uint64_t));
+    state->food_count = (int) bb->food_left;
+    state->game_over  = bb->game_over;
+}
+
+// Renvoie le nombre d'éléments qui peuvent encore etre mangés.
+int bb_food_count(const struct BitGameState *bb) {
+    const uint64_t *food      = bb_food(bb);
+    const uint64_t *superfood = bb_superfood(bb);
+    int count = 0;
+    for (size_t w = 0; w < bb->words; w++) {
+        count += __builtin_popcountll(food[w]) + __builtin_popcountll(superfood[w]);
+    }
+    return count;
+}
+
+// Renvoie la prochaine position du joueur (éventuellement impossible à
+// atteindre) s'il va dans la direction 'dir' (cf. process_user_command).
+static struct Position __next_position(const struct BitGameState *bb, struct Position pos, enum Direction dir) {
+    struct Position next = pos;
+    switch (dir) {
+    case UP:
+        if (next.y > 0) {
+            next.y -= 1;
+        }
+        break;
+    case DOWN:
+        if (next.y < bb->height - 1) {
+            next.y += 1;
+        }
+        break;
+    case LEFT:
+        if (next.x > 0) {
+            next.x -= 1;
+        }
+        break;
+    case RIGHT:
+        if (next.x < bb->width - 1) {
+            next.x += 1;
+        }
+        break;
+    }
+    return next;
+}
+
+// Envoie le message GAME_OVER (le gagnant est celui qui a le meilleur score,
+// cf. game_winner).
+static void __send_game_over(const struct BitGameState *bb, struct Sink *sink) {
+    uint32_t winner = 0;
+    for (uint32_t i = 1; i < bb->nb_players; i++) {
+        if (bb_player(bb, i)->score >= bb_player(bb, winner)->score) {
+            winner = i;
+        }
+    }
+    union Message msg = {
+        .game_over = {
+            .msgt   = GAME_OVER,
+            .winner = winner + 1
+        }
+    };
+    send_message_into(&msg, sink);
+}
+
+// Cette fonction applique une commande sur une BitGameState.
+bool bb_process_command_into(struct BitGameState *bb, enum Item player, enum Direction dir, struct Sink *sink) {
+    if (bb->game_over) {
+        __send_game_over(bb, sink);
+        flush_broadcast();
+        return true;
+    }
+
+    if (!IS_PLAYER(player) || PLAYER_INDEX(player) >= bb->nb_players) {
+        // un joueur inconnu: la commande est ignorée (cf. process_user_command_into)
+        flush_broadcast();
+        return false;
+    }
+    size_t player_offset = PLAYER_INDEX(player);
+    size_t cells         = (size_t) bb->width * bb->height;
+    uint32_t player_id   = PLAYER_ID(cells, player_offset);
+    struct BitPlayer *me  = bb_player(bb, player_offset);
+    struct Position here = me->pos;
+    struct Position next = __next_position(bb, here, dir);
+    size_t from          = (size_t) here.y * bb->width + here.x;
+    size_t index         = (size_t) next.y * bb->width + next.x;
+
+    // Si un autre joueur se trouve sur la case destination, le jeu est fini.
+    if (index != from && bb_test(bb_players(bb), index)) {
+        bb->game_over = true;
+        __send_game_over(bb, sink);
+        flush_broadcast();
+        return true;
+    }
+
+    if (bb_test(bb_walls(bb), index)) {
+        // rien ne se passe (et rien n'est envoyé)
+        flush_broadcast();
+        return false;
+    }
+
+    bb_clear(bb_players(bb), from);
+    bb_set(bb_players(bb), index);
+    me->pos = next;
+    union Message moved = {
+        .movement = {
+            .msgt = MOVEMENT,
+            .id   = player_id,
+            .pos  = next
+        }
+    };
+    send_message_into(&moved, sink);
+
+    bool food      = bb_test(bb_food(bb), index);
+    bool superfood = bb_test(bb_superfood(bb), index);
+    if (food || superfood) {
+        bb_clear(food ? bb_food(bb) : bb_superfood(bb), index);
+        me->score += food ? 1 : 17;
+        bb->food_left--;
+        bb->game_over = bb->food_left == 0;
+
+        union Message eat = {
+            .eat_food = {
+                .msgt  = EAT_FOOD,
+                .eater = player_id,
+                .food  = (uint32_t) index
+            }
+        };
+        send_message_into(&eat, sink);
+    }
+
+    if (bb->game_over) {
+        __send_game_over(bb, sink);
+    }
+
+    // tous les messages générés par cette commande partent en un seul write
+    flush_broadcast();
+    return bb->game_over;
+}
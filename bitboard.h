@@ -0,0 +1,145 @@
+#ifndef __BITBOARD__
+#define __BITBOARD__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "sink.h"
+
+// Ce module propose une autre représentation de l'état d'une partie: plutot
+// qu'un octet par case (cf. struct GameState), la map est décrite par quatre
+// 'bitboards' d'un bit par case: les murs, la nourriture, la superfood et les
+// cases occupées par un joueur. Les bitboards sont dimensionnés d'après la map
+// (et pas d'après MAP_CAPACITY): pour une map de 30x20 et 2 joueurs, tout l'état
+// d'une partie tient en 368 octets (cf. bb_size), ce qui compte quand un meme
+// processus héberge des milliers de parties (cf. engine.h).
+//
+// - Savoir si une case est un mur ou contient de la nourriture revient à
+//   tester un bit (cf. bb_test).
+// - Le nombre d'éléments qui restent à manger est compté avec popcount sur les
+//   bitboards une fois (cf. bb_food_count), puis décrémenté à chaque fois
+//   qu'un élément est mangé: un déplacement ne parcourt jamais les bitboards.
+// - bb_process_command_into fait exactement le meme travail (et envoie
+//   exactement les memes messages) que process_user_command_into.
+//
+// Les cases de la map qui ne sont ni du sol ni de la nourriture (les murs,
+// mais aussi les cases vides d'une map trop petite) sont des murs: on ne peut
+// jamais y entrer.
+
+// Un joueur d'une BitGameState.
+struct BitPlayer
+{
+    // La position du joueur.
+    struct Position pos;
+    // Le score du joueur.
+    int score;
+};
+
+// Une BitGameState a une taille variable (cf. bb_size_for): elle est allouée
+// par bb_new et libérée par free.
+struct BitGameState
+{
+    // Les dimensions de la map.
+    uint32_t width;
+    uint32_t height;
+    // Le nombre de mots de 64 bits de chaque bitboard: (width * height + 63) / 64.
+    uint32_t words;
+    // Le nombre de joueurs de la partie.
+    uint32_t nb_players;
+    // Le nombre d'éléments (nourriture et superfood) qui restent à manger.
+    uint32_t food_left;
+    // la partie est-elle en cours ou bien terminée ?
+    bool game_over;
+    // Les bitboards (cf. bb_walls, bb_food, bb_superfood et bb_players), de
+    // 'words' mots chacun, suivis des 'nb_players' joueurs (cf. bb_player).
+    // Le bit i % 64 du mot i / 64 d'un bitboard correspond à la case d'index i
+    // (cf. map_index).
+    uint64_t data[];
+};
+
+// Renvoie la taille d'une BitGameState pour une map de 'width' x 'height' cases
+// et 'nb_players' joueurs.
+static inline size_t bb_size_for(uint32_t width, uint32_t height, uint32_t nb_players) {
+    size_t words = ((size_t) width * height + 63) / 64;
+    return sizeof(struct BitGameState) + 4 * words * sizeof(uint64_t)
+           + nb_players * sizeof(struct BitPlayer);
+}
+
+// Renvoie la taille de 'bb' (à comparer avec sizeof(struct GameState)).
+static inline size_t bb_size(const struct BitGameState *bb) {
+    return bb_size_for(bb->width, bb->height, bb->nb_players);
+}
+
+// Les cases où on ne peut pas aller.
+static inline uint64_t *bb_walls(const struct BitGameState *bb) {
+    return (uint64_t *) bb->data;
+}
+
+// Les cases où se trouve de la nourriture.
+static inline uint64_t *bb_food(const struct BitGameState *bb) {
+    return (uint64_t *) bb->data + bb->words;
+}
+
+// Les cases où se trouve de la superfood.
+static inline uint64_t *bb_superfood(const struct BitGameState *bb) {
+    return (uint64_t *) bb->data + 2 * (size_t) bb->words;
+}
+
+// Les cases où se trouve un joueur.
+static inline uint64_t *bb_players(const struct BitGameState *bb) {
+    return (uint64_t *) bb->data + 3 * (size_t) bb->words;
+}
+
+// Le joueur d'index 'i' (0 <= i < nb_players).
+static inline struct BitPlayer *bb_player(const struct BitGameState *bb, size_t i) {
+    return (struct BitPlayer *) (bb->data + 4 * (size_t) bb->words) + i;
+}
+
+// Renvoie true si le bit de la case d'index 'index' est mis dans 'board'.
+static inline bool bb_test(const uint64_t *board, size_t index) {
+    return (board[index / 64] >> (index % 64)) & 1;
+}
+
+// Met le bit de la case d'index 'index' dans 'board'.
+static inline void bb_set(uint64_t *board, size_t index) {
+    board[index / 64] |= (uint64_t) 1 << (index % 64);
+}
+
+// Enlève le bit de la case d'index 'index' de 'board'.
+static inline void bb_clear(uint64_t *board, size_t index) {
+    board[index / 64] &= ~((uint64_t) 1 << (index % 64));
+}
+
+// Cette fonction alloue une BitGameState de la taille de l'état 'state' et la
+// remplit à partir de celui-ci (cf. bb_from_state). Elle doit etre libérée
+// avec free.
+struct BitGameState *bb_new(const struct GameState *state);
+
+// Cette fonction copie 'src' dans 'dst' (qui doivent avoir la meme taille,
+// cf. bb_size).
+void bb_copy(struct BitGameState *dst, const struct BitGameState *src);
+
+// Cette fonction remplit 'bb' à partir de l'état 'state' (typiquement celui
+// produit par load_map). 'bb' doit pouvoir contenir
+// bb_size_for(state->width, state->height, state->nb_players) octets.
+void bb_from_state(struct BitGameState *bb, const struct GameState *state);
+
+// Cette fonction remplit 'state' à partir de l'état 'bb' (les cases qui sont
+// des murs dans 'bb' deviennent des WALL).
+void bb_to_state(const struct BitGameState *bb, struct GameState *state);
+
+// Renvoie le nombre d'éléments (nourriture et superfood) qui peuvent encore
+// etre mangés sur la map.
+int bb_food_count(const struct BitGameState *bb);
+
+// Cette fonction fait le meme travail que process_user_command_into (cf. game.h),
+// sur une BitGameState: la commande 'dir' du joueur 'player' est appliquée et
+// les messages générés sont envoyés dans 'sink'.
+//
+// Cette fonction renvoie 'true' si la partie est terminée, false sinon.
+bool bb_process_command_into(struct BitGameState *bb, enum Item player, enum Direction dir, struct Sink *sink);
+
+#endif //__BITBOARD__
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+
+#include "bot.h"
+
+// Une case à partir de laquelle la réparation d'une FoodField repart (cf. food_field_eaten).
+struct Seed
+{
+    MapIndex cell;
+    MapIndex dist;
+    MapIndex source;
+};
+
+// Les files des parcours en largeur (et la région réparée par food_field_eaten):
+// trop grandes pour la pile avec de très grandes maps (cf. MAX_WIDTH).
+static MapIndex __queue[MAP_CAPACITY];
+static MapIndex __region[MAP_CAPACITY];
+static struct Seed __seeds[MAP_CAPACITY];
+
+// Renvoie la i-eme case voisine de 'cell' (PATH_UNREACHABLE s'il n'y en a pas:
+// un mur ou le bord de la map).
+static MapIndex __neighbour(const struct MoveTable *moves, size_t cell, int i) {
+    MapIndex next = moves->next[cell][i];
+    return next == MOVE_BLOCKED || next == cell ? PATH_UNREACHABLE : next;
+}
+
+// Parcours en largeur depuis les 'count' premières cases de 'queue' (dont
+// 'dist' et 'source' sont déjà remplis): chaque case atteinte reçoit sa distance
+// et la source de la case depuis laquelle elle a été atteinte.
+static void __bfs(const struct MoveTable *moves, MapIndex *dist, MapIndex *source,
+                  MapIndex *queue, size_t count) {
+    for (size_t head = 0; head < count; head++) {
+        MapIndex cell = queue[head];
+        for (int i = 0; i < 4; i++) {
+            MapIndex next = __neighbour(moves, cell, i);
+            if (next != PATH_UNREACHABLE && dist[next] == PATH_UNREACHABLE) {
+                dist[next] = dist[cell] + 1;
+                if (source != NULL) {
+                    source[next] = source[cell];
+                }
+                queue[count++] = next;
+            }
+        }
+    }
+}
+
+// Cette fonction calcule la distance de chaque case à la case 'target'.
+void path_distances(const struct MoveTable *moves, size_t target, MapIndex *dist) {
+    for (size_t i = 0; i < moves->cells; i++) {
+        dist[i] = PATH_UNREACHABLE;
+    }
+    dist[target] = 0;
+    __queue[0]   = (MapIndex) target;
+    __bfs(moves, dist, NULL, __queue, 1);
+}
+
+// Cette fonction calcule la distance de chaque case à la nourriture la plus proche.
+void food_field_build(struct FoodField *field, const struct GameState *state, const struct MoveTable *moves) {
+    size_t count = 0;
+    for (size_t i = 0; i < map_cells(state); i++) {
+        if (state->map[i] == FOOD || state->map[i] == SUPERFOOD) {
+            field->dist[i]   = 0;
+            field->source[i] = (MapIndex) i;
+            __queue[count++] = (MapIndex) i;
+        } else {
+            field->dist[i]   = PATH_UNREACHABLE;
+            field->source[i] = PATH_UNREACHABLE;
+        }
+    }
+    __bfs(moves, field->dist, field->source, __queue, count);
+}
+
+// Compare deux Seed selon leur distance (cf. qsort).
+static int __compare_seeds(const void *a, const void *b) {
+    return (int) ((const struct Seed *) a)->dist - (int) ((const struct Seed *) b)->dist;
+}
+
+// Met 'cell' à jour si elle est plus proche de 'source' via une voisine à
+// distance 'dist' - 1. Renvoie true si c'est le cas.
+static bool __relax(struct FoodField *field, MapIndex cell, MapIndex dist, MapIndex source) {
+    if (dist >= field->dist[cell]) {
+        return false;
+    }
+    field->dist[cell]   = dist;
+    field->source[cell] = source;
+    return true;
+}
+
+// Cette fonction met 'field' à jour après que la nourriture 'index' a été mangée.
+void food_field_eaten(struct FoodField *field, const struct MoveTable *moves, size_t index) {
+    if (field->source[index] != index) {
+        // ce n'était pas (ou plus) de la nourriture
+        return;
+    }
+
+    // 1. les cases dont c'était la nourriture la plus proche sont oubliées. Elles
+    //    forment un arbre de racine 'index' (chacune a été atteinte depuis une
+    //    voisine de meme source): on les trouve en partant de 'index', sans
+    //    parcourir toute la map.
+    MapIndex *region = __region;
+    size_t nb_region = 0;
+    field->dist[index]   = PATH_UNREACHABLE;
+    field->source[index] = PATH_UNREACHABLE;
+    region[nb_region++]  = (MapIndex) index;
+    for (size_t r = 0; r < nb_region; r++) {
+        for (int i = 0; i < 4; i++) {
+            MapIndex next = __neighbour(moves, region[r], i);
+            if (next != PATH_UNREACHABLE && field->source[next] == index) {
+                field->dist[next]   = PATH_UNREACHABLE;
+                field->source[next] = PATH_UNREACHABLE;
+                region[nb_region++] = next;
+            }
+        }
+    }
+
+    // 2. elles peuvent désormais etre atteintes depuis leurs voisines qui ne
+    //    sont pas concernées (et qui gardent leur distance)
+    struct Seed *seeds = __seeds;
+    size_t nb_seeds    = 0;
+    for (size_t r = 0; r < nb_region; r++) {
+        struct Seed best = { .cell = region[r], .dist = PATH_UNREACHABLE, .source = PATH_UNREACHABLE };
+        for (int i = 0; i < 4; i++) {
+            MapIndex next = __neighbour(moves, region[r], i);
+            if (next != PATH_UNREACHABLE && field->dist[next] < PATH_UNREACHABLE
+             && field->dist[next] + 1 < best.dist) {
+                best.dist   = field->dist[next] + 1;
+                best.source = field->source[next];
+            }
+        }
+        if (best.dist != PATH_UNREACHABLE) {
+            seeds[nb_seeds++] = best;
+        }
+    }
+    qsort(seeds, nb_seeds, sizeof(struct Seed), __compare_seeds);
+
+    // 3. parcours en largeur dans la région, à partir des seeds (par distance
+    //    croissante) et des cases déjà atteintes (dans l'ordre où elles l'ont été)
+    MapIndex *queue = __queue;
+    size_t head = 0, tail = 0, s = 0;
+    while (s < nb_seeds || head < tail) {
+        MapIndex cell;
+        if (s < nb_seeds && (head == tail || seeds[s].dist <= field->dist[queue[head]])) {
+            if (!__relax(field, seeds[s].cell, seeds[s].dist, seeds[s].source)) {
+                s++;
+                continue;
+            }
+            cell = seeds[s++].cell;
+        } else {
+            cell = queue[head++];
+        }
+        for (int i = 0; i < 4; i++) {
+            MapIndex next = __neighbour(moves, cell, i);
+            if (next != PATH_UNREACHABLE && __relax(field, next, field->dist[cell] + 1, field->source[cell])) {
+                queue[tail++] = next;
+            }
+        }
+    }
+}
+
+// Cette fonction choisit la direction du bot qui controle 'player'.
+enum Direction bot_choose(const struct GameState *state, const struct MoveTable *moves,
+                          const struct FoodField *field, enum Item player) {
+    size_t offset = PLAYER_INDEX(player);
+    size_t here   = map_index(state, state->positions[offset]);
+    // en cas de collision, c'est celui qui a le plus de points qui gagne (cf.
+    // process_user_command): le bot ne s'y risque que s'il en a strictement
+    // plus que tous les autres joueurs
+    bool ahead = true;
+    for (size_t i = 0; i < state->nb_players; i++) {
+        if (i != offset && state->scores[i] >= state->scores[offset]) {
+            ahead = false;
+        }
+    }
+
+    enum Direction best = DOWN;
+    uint64_t best_dist  = UINT64_MAX;
+    for (int dir = DOWN; dir <= UP; dir++) {
+        MapIndex next = moves->next[here][dir];
+        if (next == MOVE_BLOCKED) {
+            continue;
+        }
+        if (next != here && map_occupied(state, next)) {
+            if (ahead) {
+                // percuter un autre joueur termine la partie... que le bot gagne
+                return (enum Direction) dir;
+            }
+            continue;
+        }
+        // tant qu'il n'y a plus de nourriture accessible, le bot bouge quand meme
+        uint64_t dist = field->dist[next] == PATH_UNREACHABLE ? (uint64_t) PATH_UNREACHABLE : field->dist[next];
+        if (next == here) {
+            dist = UINT64_MAX - 1;
+        }
+        if (dist < best_dist) {
+            best      = (enum Direction) dir;
+            best_dist = dist;
+        }
+    }
+    return best;
+}
+
+// Cette fonction applique une commande et tient 'field' à jour.
+bool bot_command_into(struct GameState *state, const struct MoveTable *moves, struct FoodField *field,
+                      enum Item player, enum Direction dir, struct Sink *sink) {
+    int food_before = state->food_count;
+    bool over = process_user_command_table_into(state, moves, player, dir, sink);
+    if (state->food_count < food_before) {
+        // le joueur a mangé la nourriture de la case où il vient d'arriver
+        food_field_eaten(field, moves, map_index(state, state->positions[PLAYER_INDEX(player)]));
+    }
+    return over;
+}
+
+// Cette fonction fait jouer le bot qui controle 'player'.
+bool bot_play_into(struct GameState *state, const struct MoveTable *moves, struct FoodField *field,
+                   enum Item player, struct Sink *sink) {
+    enum Direction dir = bot_choose(state, moves, field, player);
+    return bot_command_into(state, moves, field, player, dir, sink);
+}
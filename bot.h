@@ -0,0 +1,78 @@
+#ifndef __BOT__
+#define __BOT__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "sink.h"
+
+// Ce module permet au serveur de faire jouer lui-meme un joueur (un 'bot'),
+// par exemple pour remplacer un joueur qui manque. Il s'appuie sur la table
+// des déplacements de la map (cf. struct MoveTable dans game.h):
+//
+// - path_distances calcule (par un parcours en largeur) la distance de chaque
+//   case à une case cible donnée.
+// - Une FoodField donne, pour chaque case, la distance jusqu'à la nourriture
+//   (ou superfood) la plus proche et de quelle nourriture il s'agit. Elle est
+//   calculée une fois au début de la partie, puis réparée localement chaque fois
+//   qu'une nourriture est mangée: seules les cases pour lesquelles c'était la
+//   plus proche sont recalculées.
+// - bot_choose choisit la direction d'un bot: vers la nourriture la plus
+//   proche, sans jamais percuter un autre joueur (ce qui termine la partie),
+//   sauf si le bot a plus de points que tous les autres (et gagne donc la
+//   partie en le faisant).
+//
+// Tout cela ne fait aucune allocation et ne touche que quelques Ko: une commande
+// d'un bot coute de l'ordre de la microseconde, réparation de la FoodField
+// comprise (cf. le mode "bots" de bench_game). Les files des parcours en largeur
+// sont des buffers statiques du module (dimensionnés pour MAP_CAPACITY cases):
+// ces fonctions ne doivent donc pas etre appelées par plusieurs threads à la fois.
+
+// La distance d'une case depuis laquelle on ne peut pas atteindre la cible.
+#define PATH_UNREACHABLE MAP_INDEX_NONE
+
+// La distance de chaque case à la nourriture la plus proche.
+struct FoodField
+{
+    // La distance (en nombre de déplacements) de chaque case à la nourriture
+    // la plus proche (PATH_UNREACHABLE s'il n'y en a aucune d'accessible).
+    MapIndex dist[MAP_CAPACITY];
+    // L'index de cette nourriture (PATH_UNREACHABLE s'il n'y en a aucune).
+    MapIndex source[MAP_CAPACITY];
+};
+
+// Cette fonction calcule dans 'dist' la distance (en nombre de déplacements)
+// de chaque case de la map à la case d'index 'target' (PATH_UNREACHABLE si
+// on ne peut pas l'atteindre depuis cette case).
+void path_distances(const struct MoveTable *moves, size_t target, MapIndex *dist);
+
+// Cette fonction calcule 'field' pour la nourriture qui se trouve sur la map de 'state'.
+void food_field_build(struct FoodField *field, const struct GameState *state, const struct MoveTable *moves);
+
+// Cette fonction met 'field' à jour après que la nourriture de la case
+// d'index 'index' a été mangée (cf. EAT_FOOD).
+void food_field_eaten(struct FoodField *field, const struct MoveTable *moves, size_t index);
+
+// Cette fonction renvoie la direction que le bot qui controle 'player' choisit
+// de prendre dans la partie 'state'.
+enum Direction bot_choose(const struct GameState *state, const struct MoveTable *moves,
+                          const struct FoodField *field, enum Item player);
+
+// Cette fonction fait la meme chose que process_user_command_table_into (cf. game.h),
+// mais tient aussi 'field' à jour si le joueur a mangé de la nourriture. Toutes les
+// commandes d'une partie où jouent des bots (y compris celles des joueurs humains)
+// doivent passer par cette fonction.
+bool bot_command_into(struct GameState *state, const struct MoveTable *moves, struct FoodField *field,
+                      enum Item player, enum Direction dir, struct Sink *sink);
+
+// Cette fonction fait jouer le bot qui controle 'player' (cf. bot_choose et
+// bot_command_into).
+//
+// Cette fonction renvoie 'true' si la partie est terminée, false sinon.
+bool bot_play_into(struct GameState *state, const struct MoveTable *moves, struct FoodField *field,
+                   enum Item player, struct Sink *sink);
+
+#endif //__BOT__
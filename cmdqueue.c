@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "utils_v3.h"
+
+#include "cmdqueue.h"
+
+// Cette fonction initialise une file vide.
+void cmdq_init(struct CommandQueue *queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    for (uint64_t i = 0; i < CMDQ_CAPACITY; i++) {
+        // la case i peut etre remplie quand head == i
+        atomic_init(&queue->slots[i].seq, i);
+    }
+}
+
+// Cette fonction crée un segment de mémoire partagée qui contient une file vide.
+int cmdq_shm_create(key_t key, int perm) {
+    int shm_id = sshmget(key, sizeof(struct CommandQueue), IPC_CREAT | perm);
+    struct CommandQueue *queue = sshmat(shm_id);
+    cmdq_init(queue);
+    sshmdt(queue);
+    return shm_id;
+}
+
+// Cette fonction attache la file contenue dans le segment 'shm_id'.
+struct CommandQueue *cmdq_shm_attach(int shm_id) {
+    return sshmat(shm_id);
+}
+
+// Renvoie l'heure courante (CLOCK_MONOTONIC) en nanosecondes.
+uint64_t cmdq_now(void) {
+    struct timespec now;
+    checkNeg(clock_gettime(CLOCK_MONOTONIC, &now), "Error CLOCK_GETTIME");
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+// Cette fonction ajoute la commande 'cmd' à la file.
+bool cmdq_push(struct CommandQueue *queue, const struct Command *cmd) {
+    uint64_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    struct CommandSlot *slot;
+    for (;;) {
+        slot = &queue->slots[pos & (CMDQ_CAPACITY - 1)];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int64_t diff = (int64_t) (seq - pos);
+        if (diff == 0) {
+            // la case est libre: on essaie de la réserver
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+            // un autre producteur l'a prise, 'pos' a été mis à jour
+        } else if (diff < 0) {
+            // la case n'a pas encore été lue par le consommateur: la file est pleine
+            return false;
+        } else {
+            // un autre producteur a déjà rempli cette case
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    slot->cmd = *cmd;
+    // la case peut maintenant etre lue
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+// Cette fonction retire de la file (au plus) 'max' commandes.
+size_t cmdq_pop_batch(struct CommandQueue *queue, struct Command *out, size_t max) {
+    uint64_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t count = 0;
+    while (count < max) {
+        struct CommandSlot *slot = &queue->slots[pos & (CMDQ_CAPACITY - 1)];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != pos + 1) {
+            // la case n'a pas (encore) été remplie
+            break;
+        }
+        out[count++] = slot->cmd;
+        // la case pourra etre remplie à nouveau au tour suivant
+        atomic_store_explicit(&slot->seq, pos + CMDQ_CAPACITY, memory_order_release);
+        pos++;
+    }
+    atomic_store_explicit(&queue->tail, pos, memory_order_relaxed);
+    return count;
+}
+
+// Cette fonction traite les 'count' commandes de 'cmds' et envoie tous leurs messages d'un coup.
+bool cmdq_apply(struct GameState *state, const struct Command *cmds, size_t count, struct Sink *sink) {
+    // les messages de toutes les commandes restent en attente...
+    bool deferred  = sink->deferred;
+    bool over      = state->game_over;
+    sink->deferred = true;
+    for (size_t i = 0; i < count; i++) {
+        over = process_user_command_into(state, cmds[i].player, cmds[i].dir, sink);
+    }
+    sink->deferred = deferred;
+    // ... et partent d'un coup
+    flush_sink(sink);
+    return over;
+}
+
+// Cette fonction retire de la file (au plus) 'max' commandes et les traite.
+size_t cmdq_drain(struct CommandQueue *queue, struct GameState *state, size_t max,
+                  struct Sink *sink, bool *over) {
+    struct Command batch[CMDQ_MAX_BATCH];
+    size_t total = 0;
+    *over = state->game_over;
+    while (total < max) {
+        size_t wanted = max - total < CMDQ_MAX_BATCH ? max - total : CMDQ_MAX_BATCH;
+        size_t count  = cmdq_pop_batch(queue, batch, wanted);
+        if (count == 0) {
+            break;
+        }
+        *over  = cmdq_apply(state, batch, count, sink);
+        total += count;
+    }
+    return total;
+}
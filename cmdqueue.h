@@ -0,0 +1,111 @@
+#ifndef __CMDQUEUE__
+#define __CMDQUEUE__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "sink.h"
+
+// Ce module fournit une file de commandes bornée, sans verrou, qui permet à
+// plusieurs producteurs (les processus ou threads qui lisent les commandes des
+// clients) de transmettre leurs commandes à un seul consommateur (la boucle
+// qui fait tourner le jeu), sans passer par sem_down/sem_up.
+//
+// - Pousser une commande ne fait aucun appel système: les producteurs se
+//   réservent une case avec une seule opération atomique et ne s'attendent
+//   jamais les uns les autres (ils ne voient que la file pleine).
+// - Le consommateur vide la file par lots (cf. cmdq_drain): les messages
+//   générés par tout un lot partent d'un coup dans le sink (cf. sink.h).
+// - La file a une taille fixe et ne contient aucun pointeur: elle peut donc
+//   etre placée en mémoire partagée (cf. cmdq_shm_create et cmdq_shm_attach).
+//
+// Chaque case porte un numéro de séquence qui indique si elle peut etre
+// remplie (seq == position) ou lue (seq == position + 1). C'est ce qui permet
+// aux producteurs et au consommateur de se synchroniser sans verrou.
+
+// Le nombre de cases de la file (doit etre une puissance de 2).
+#define CMDQ_CAPACITY 1024
+
+// Le nombre maximum de commandes traitées d'un coup par cmdq_drain.
+#define CMDQ_MAX_BATCH 64
+
+// Une commande d'un joueur.
+struct Command
+{
+    // Le joueur qui a envoyé la commande (PLAYER1, PLAYER2, ...).
+    enum Item player;
+    // La direction demandée.
+    enum Direction dir;
+    // Le moment où la commande a été reçue (en ns, cf. cmdq_now).
+    uint64_t timestamp;
+};
+
+// Une case de la file.
+struct CommandSlot
+{
+    _Atomic uint64_t seq;
+    struct Command cmd;
+};
+
+struct CommandQueue
+{
+    // La prochaine position à remplir (partagée par les producteurs).
+    _Alignas(64) _Atomic uint64_t head;
+    // La prochaine position à lire (propre au consommateur). Elle est sur une
+    // autre ligne de cache que 'head' pour que producteurs et consommateur ne
+    // se gênent pas.
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) struct CommandSlot slots[CMDQ_CAPACITY];
+};
+
+// Cette fonction initialise une file vide.
+void cmdq_init(struct CommandQueue *queue);
+
+// Cette fonction crée un segment de mémoire partagée (de clé 'key' et de
+// permissions 'perm') qui contient une file vide. Elle renvoie l'identifiant
+// du segment (cf. sshmdelete pour le supprimer).
+int cmdq_shm_create(key_t key, int perm);
+
+// Cette fonction attache la file contenue dans le segment 'shm_id' (cf. sshmdt
+// pour la détacher). Un processus créé par fork après l'attachement n'a pas
+// besoin de l'attacher à nouveau.
+struct CommandQueue *cmdq_shm_attach(int shm_id);
+
+// Renvoie l'heure courante (CLOCK_MONOTONIC) en nanosecondes.
+uint64_t cmdq_now(void);
+
+// Cette fonction ajoute la commande 'cmd' à la file. Elle peut etre appelée par
+// plusieurs producteurs en meme temps.
+//
+// Elle renvoie false (et n'ajoute rien) si la file est pleine.
+bool cmdq_push(struct CommandQueue *queue, const struct Command *cmd);
+
+// Cette fonction retire de la file (au plus) 'max' commandes, dans l'ordre où
+// elles ont été ajoutées, et les stocke dans 'out'. Elle ne doit etre appelée
+// que par le consommateur.
+//
+// Elle renvoie le nombre de commandes retirées (0 si la file est vide).
+size_t cmdq_pop_batch(struct CommandQueue *queue, struct Command *out, size_t max);
+
+// Cette fonction traite les 'count' commandes de 'cmds' (dans l'ordre) avec 
+// process_user_command_into. Tous les messages générés sont envoyés d'un coup
+// dans le sink (en un seul write pour un sink SINK_FD).
+//
+// Elle renvoie 'true' si la partie est terminée, false sinon.
+bool cmdq_apply(struct GameState *state, const struct Command *cmds, size_t count, struct Sink *sink);
+
+// Cette fonction retire de la file (au plus) 'max' commandes et les traite par
+// lots de CMDQ_MAX_BATCH (cf. cmdq_apply). Elle ne doit etre appelée que par le
+// consommateur.
+//
+// Elle renvoie le nombre de commandes traitées, et met 'over' à true si la
+// partie est terminée.
+size_t cmdq_drain(struct CommandQueue *queue, struct GameState *state, size_t max,
+                  struct Sink *sink, bool *over);
+
+#endif //__CMDQUEUE__
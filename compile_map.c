@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include "utils_v3.h"
+#include "compiled_map.h"
+
+// ********************************************************************************
+// OUTIL HORS-LIGNE: COMPILATION DES MAPS
+// ================================================================================
+// Transforme une map texte (resources/mapX.txt) en map compilée, que le serveur
+// peut charger avec open_compiled_map + load_compiled_map (cf. compiled_map.h).
+//
+// Usage: ./compile_map resources/map.txt resources/map.bin
+//        (ou simplement 'make maps' pour compiler toutes les maps)
+// ********************************************************************************
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s map.txt map.bin\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FileDescriptor fdmap = sopen(argv[1], O_RDONLY, 0);
+    FileDescriptor fdout = sopen(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    compile_map(fdmap, fdout);
+    sclose(fdout);
+    sclose(fdmap);
+
+    // on vérifie que le fichier produit est bien lisible
+    struct CompiledMap map;
+    if (!open_compiled_map(argv[2], &map)) {
+        fprintf(stderr, "%s: invalid compiled map\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    printf("%s: %zu messages, %d food\n", argv[2], map.nb_messages, map.state->food_count);
+    close_compiled_map(&map);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils_v3.h"
+#include "sink.h"
+
+#include "compiled_map.h"
+
+// Cette fonction lit la map texte stockée dans le fichier 'fdmap' et écrit
+// sa version compilée dans le fichier 'fdout'.
+void compile_map(FileDescriptor fdmap, FileDescriptor fdout) {
+    // les messages générés par load_map sont capturés dans un fichier temporaire
+    FILE *tmp = tmpfile();
+    checkNull(tmp, "Error TMPFILE");
+    FileDescriptor fdtmp = fileno(tmp);
+
+    // on met tout à zéro (y compris le padding) pour que le fichier produit
+    // ne dépende que de la map.
+    struct GameState state;
+    memset(&state, 0, sizeof(struct GameState));
+    load_map(fdmap, fdtmp, &state);
+
+    checkNeg(lseek(fdtmp, 0, SEEK_SET), "Error LSEEK");
+    size_t len;
+    char *stream = readFileToBuffer(fdtmp, &len);
+    fclose(tmp);
+
+    struct CompiledMapHeader header = {
+        .magic        = COMPILED_MAP_MAGIC,
+        .version      = COMPILED_MAP_VERSION,
+        .state_size   = sizeof(struct GameState),
+        .message_size = sizeof(union Message),
+        .nb_messages  = len / sizeof(union Message),
+        .reserved     = 0
+    };
+
+    nwrite(fdout, &header, sizeof(struct CompiledMapHeader));
+    nwrite(fdout, &state, sizeof(struct GameState));
+    nwrite(fdout, stream, len);
+    free(stream);
+}
+
+// Cette fonction projette en mémoire la map compilée stockée dans le fichier
+// 'path' et initialise 'map' en conséquence.
+bool open_compiled_map(const char *path, struct CompiledMap *map) {
+    FileDescriptor fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    checkNeg(fstat(fd, &st), "Error FSTAT");
+    size_t size = (size_t) st.st_size;
+    if (size < sizeof(struct CompiledMapHeader) + sizeof(struct GameState)) {
+        sclose(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    checkCond(base == MAP_FAILED, "Error MMAP");
+    sclose(fd);
+
+    const struct CompiledMapHeader *header = base;
+    size_t expected = sizeof(struct CompiledMapHeader)
+                    + sizeof(struct GameState)
+                    + header->nb_messages * sizeof(union Message);
+    if (header->magic        != COMPILED_MAP_MAGIC
+     || header->version      != COMPILED_MAP_VERSION
+     || header->state_size   != sizeof(struct GameState)
+     || header->message_size != sizeof(union Message)
+     || expected             != size) {
+        checkNeg(munmap(base, size), "Error MUNMAP");
+        return false;
+    }
+
+    const char *payload = (const char *) base + sizeof(struct CompiledMapHeader);
+    map->base        = base;
+    map->size        = size;
+    map->state       = (const struct GameState *) payload;
+    map->messages    = (const union Message *) (payload + sizeof(struct GameState));
+    map->nb_messages = header->nb_messages;
+    return true;
+}
+
+// Cette fonction fait la meme chose que load_map, mais à partir d'une map
+// compilée.
+void load_compiled_map(const struct CompiledMap *map, FileDescriptor fdbcast, struct GameState *state) {
+    struct Sink sink = sink_fd(fdbcast);
+    load_compiled_map_into(map, &sink, state);
+}
+
+// Cette fonction fait la meme chose que load_compiled_map, mais les messages
+// sont envoyés dans 'sink'.
+void load_compiled_map_into(const struct CompiledMap *map, struct Sink *sink, struct GameState *state) {
+    // seules les pages de la projection qui contiennent la map sont lues
+    copy_gamestate(state, map->state);
+    broadcast_messages_into(map->messages, map->nb_messages, sink);
+}
+
+// Cette fonction libère la projection d'une map compilée.
+void close_compiled_map(struct CompiledMap *map) {
+    checkNeg(munmap(map->base, map->size), "Error MUNMAP");
+    map->base = NULL;
+    map->size = 0;
+}
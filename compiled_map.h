@@ -0,0 +1,87 @@
+#ifndef __COMPILED_MAP__
+#define __COMPILED_MAP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "sink.h"
+
+// Une map compilée est la version binaire d'un fichier 'resources/mapX.txt'.
+// Elle est produite hors-ligne par l'outil 'compile_map' (cf. Makefile) et
+// contient tout ce que load_map calcule au démarrage d'une partie:
+//
+//   +---------------------------+
+//   | struct CompiledMapHeader  |
+//   +---------------------------+
+//   | struct GameState          |  <- état initial, copié en un seul memcpy
+//   +---------------------------+
+//   | union Message[nb_messages]|  <- les messages générés par load_map,
+//   +---------------------------+     envoyés tels quels aux clients
+//
+// Le fichier est projeté en mémoire (mmap): charger une partie ne demande
+// donc plus ni parsing, ni encodage des messages.
+//
+// NOTE: le format dépend de la disposition en mémoire de struct GameState et
+//       de union Message. Une map compilée avec une autre version du code est
+//       simplement refusée (il suffit alors de la recompiler).
+
+// "PCMB" (Pas-Cman Map Binary)
+#define COMPILED_MAP_MAGIC   0x424d4350
+#define COMPILED_MAP_VERSION 3
+
+// L'entete d'un fichier de map compilée.
+struct CompiledMapHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // La taille de struct GameState lors de la compilation.
+    uint32_t state_size;
+    // La taille de union Message lors de la compilation.
+    uint32_t message_size;
+    // Le nombre de messages qui suivent la GameState.
+    uint32_t nb_messages;
+    uint32_t reserved;
+};
+
+// Une map compilée qui a été projetée en mémoire.
+struct CompiledMap
+{
+    // L'adresse et la taille de la projection.
+    void  *base;
+    size_t size;
+    // L'état initial du jeu (dans la projection).
+    const struct GameState *state;
+    // Le flux de messages à envoyer aux clients (dans la projection).
+    const union Message *messages;
+    size_t nb_messages;
+};
+
+// Cette fonction lit la map texte stockée dans le fichier 'fdmap' et écrit
+// sa version compilée dans le fichier 'fdout'.
+//
+// NOTE: Cette fonction ne ferme AUCUN FileDescriptor.
+void compile_map(FileDescriptor fdmap, FileDescriptor fdout);
+
+// Cette fonction projette en mémoire la map compilée stockée dans le fichier
+// 'path' et initialise 'map' en conséquence.
+//
+// Elle renvoie false si le fichier n'existe pas ou s'il ne s'agit pas d'une
+// map compilée valide pour cette version du code (l'appelant peut alors se
+// rabattre sur load_map et le fichier texte).
+bool open_compiled_map(const char *path, struct CompiledMap *map);
+
+// Cette fonction fait la meme chose que load_map, mais à partir d'une map
+// compilée: la GameState est copiée en un seul memcpy et les messages sont
+// envoyés sur 'fdbcast' directement depuis les pages projetées.
+void load_compiled_map(const struct CompiledMap *map, FileDescriptor fdbcast, struct GameState *state);
+
+// Idem load_compiled_map, mais les messages sont envoyés dans 'sink' (cf. sink.h).
+void load_compiled_map_into(const struct CompiledMap *map, struct Sink *sink, struct GameState *state);
+
+// Cette fonction libère la projection d'une map compilée.
+void close_compiled_map(struct CompiledMap *map);
+
+#endif //__COMPILED_MAP__
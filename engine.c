@@ -0,0 +1,312 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "utils_v3.h"
+#include "sink.h"
+
+#include "engine.h"
+
+// Le nombre maximum de sockets signalées par un seul evloop_wait.
+#define ENGINE_MAX_EVENTS 256
+
+// Cette fonction crée un moteur capable d'héberger 'capacity' parties.
+struct GameEngine *engine_create(size_t capacity, int max_fd) {
+    checkCond(capacity == 0 || capacity > INT32_MAX, "Error: invalid engine capacity");
+    checkCond(max_fd <= 0, "Error: invalid engine max_fd");
+
+    struct GameEngine *engine = smalloc(sizeof(struct GameEngine));
+    engine->capacity      = capacity;
+    engine->nb_games      = 0;
+    engine->states        = smalloc(capacity * sizeof(struct GameState));
+    engine->games         = smalloc(capacity * sizeof(struct EngineGame));
+    engine->touched       = smalloc(capacity * sizeof(int));
+    engine->backlogged    = smalloc(capacity * sizeof(int));
+    engine->nb_backlogged = 0;
+    engine->clients       = smalloc((size_t) max_fd * sizeof(struct EngineClient));
+    engine->max_fd        = max_fd;
+
+    // toutes les parties sont libres: elles sont chainées dans l'ordre
+    for (size_t i = 0; i < capacity; i++) {
+        engine->games[i].in_use       = false;
+        engine->games[i].touched      = false;
+        engine->games[i].nb_clients   = 0;
+        engine->games[i].backlog_slot = -1;
+        engine->games[i].next_free    = i + 1 < capacity ? (int) (i + 1) : ENGINE_NO_GAME;
+    }
+    engine->free_list = 0;
+
+    for (int fd = 0; fd < max_fd; fd++) {
+        engine->clients[fd].game       = ENGINE_NO_GAME;
+        engine->clients[fd].nb_pending = 0;
+    }
+
+    size_t max_events = capacity * NB_PLAYERS < ENGINE_MAX_EVENTS ? capacity * NB_PLAYERS : ENGINE_MAX_EVENTS;
+    engine->loop  = evloop_create((int) max_events);
+    engine->ready = smalloc(max_events * sizeof(int));
+    return engine;
+}
+
+// Cette fonction termine toutes les parties et libère le moteur.
+void engine_free(struct GameEngine *engine) {
+    for (size_t i = 0; i < engine->capacity; i++) {
+        if (engine->games[i].in_use) {
+            engine_end_game(engine, (int) i);
+        }
+    }
+    evloop_free(engine->loop);
+    free(engine->ready);
+    free(engine->clients);
+    free(engine->touched);
+    free(engine->backlogged);
+    free(engine->games);
+    free(engine->states);
+    free(engine);
+}
+
+// Cette fonction crée une nouvelle partie à partir de l'état 'initial'.
+int engine_new_game(struct GameEngine *engine, const struct GameState *initial) {
+    int game = engine->free_list;
+    if (game == ENGINE_NO_GAME) {
+        return ENGINE_NO_GAME;
+    }
+
+    struct EngineGame *meta = &engine->games[game];
+    engine->free_list  = meta->next_free;
+    meta->in_use       = true;
+    meta->touched      = false;
+    meta->nb_clients   = 0;
+    meta->nb_players   = 0;
+    meta->broadcaster  = bcast_create(ENGINE_MAX_CLIENTS, ENGINE_MAX_BACKLOG, BCAST_DISCONNECT);
+    meta->backlog      = 0;
+    meta->backlog_slot = -1;
+    copy_gamestate(&engine->states[game], initial);
+    engine->nb_games++;
+    return game;
+}
+
+// Ajoute la partie 'game' aux parties qui ont un backlog (si elle n'y est pas
+// encore), ou l'en retire (si elle y est) selon que son backlog est vide ou non.
+static void __update_backlogged(struct GameEngine *engine, int game) {
+    struct EngineGame *meta = &engine->games[game];
+    if (meta->backlog > 0 && meta->backlog_slot < 0) {
+        meta->backlog_slot = (int) engine->nb_backlogged;
+        engine->backlogged[engine->nb_backlogged++] = game;
+    } else if (meta->backlog == 0 && meta->backlog_slot >= 0) {
+        // la dernière partie de la liste prend sa place
+        int last = engine->backlogged[--engine->nb_backlogged];
+        engine->backlogged[meta->backlog_slot] = last;
+        engine->games[last].backlog_slot       = meta->backlog_slot;
+        meta->backlog_slot = -1;
+    }
+}
+
+// Vérifie que 'game' est bien une partie en cours.
+static struct EngineGame *__game(struct GameEngine *engine, int game) {
+    checkCond(game < 0 || (size_t) game >= engine->capacity || !engine->games[game].in_use,
+              "Error: no such game");
+    return &engine->games[game];
+}
+
+// Cette fonction termine la partie 'game' et libère sa place.
+void engine_end_game(struct GameEngine *engine, int game) {
+    struct EngineGame *meta = __game(engine, game);
+    while (meta->nb_clients > 0) {
+        engine_detach(engine, meta->clients[0]);
+    }
+    bcast_free(meta->broadcaster);
+    meta->broadcaster = NULL;
+    meta->backlog     = 0;
+    __update_backlogged(engine, game);
+    meta->in_use      = false;
+    meta->next_free   = engine->free_list;
+    engine->free_list = game;
+    engine->nb_games--;
+}
+
+// Renvoie l'état de la partie 'game'.
+struct GameState *engine_state(struct GameEngine *engine, int game) {
+    __game(engine, game);
+    return &engine->states[game];
+}
+
+// Ajoute le client 'socket' à la partie 'game': il reçoit l'état courant de la
+// partie, puis tous les messages de la partie via son Broadcaster.
+static void __join(struct GameEngine *engine, int game, FileDescriptor socket, enum Item player) {
+    struct EngineGame *meta = &engine->games[game];
+    checkCond(meta->nb_clients >= ENGINE_MAX_CLIENTS, "Error: too many clients in the game");
+    checkCond(socket < 0 || socket >= engine->max_fd, "Error: socket out of the engine range");
+    checkCond(engine->clients[socket].game != ENGINE_NO_GAME, "Error: socket already attached");
+
+    struct EngineClient *client = &engine->clients[socket];
+    client->game       = game;
+    client->player     = player;
+    client->nb_pending = 0;
+    meta->clients[meta->nb_clients++] = socket;
+
+    // l'état courant est envoyé avant que la socket ne devienne non bloquante
+    send_state(&engine->states[game], socket);
+    bcast_subscribe(meta->broadcaster, socket);
+    evloop_add(engine->loop, socket);
+}
+
+// Cette fonction ajoute un client à la partie 'game'.
+void engine_attach(struct GameEngine *engine, int game, FileDescriptor socket, enum Item player) {
+    struct EngineGame *meta = __game(engine, game);
+    checkCond(meta->nb_players >= engine->states[game].nb_players, "Error: the game is full");
+    checkCond(!IS_PLAYER(player) || PLAYER_INDEX(player) >= engine->states[game].nb_players, "Error: invalid player");
+
+    send_registered((uint32_t) PLAYER_INDEX(player) + 1, socket);
+    __join(engine, game, socket, player);
+    meta->nb_players++;
+}
+
+// Cette fonction ajoute un spectateur à la partie 'game'.
+void engine_watch(struct GameEngine *engine, int game, FileDescriptor socket) {
+    __game(engine, game);
+    __join(engine, game, socket, ENGINE_SPECTATOR);
+}
+
+// Cette fonction retire 'socket' de sa partie et la ferme.
+void engine_detach(struct GameEngine *engine, FileDescriptor socket) {
+    checkCond(socket < 0 || socket >= engine->max_fd || engine->clients[socket].game == ENGINE_NO_GAME,
+              "Error: socket not attached");
+    struct EngineClient *client = &engine->clients[socket];
+    struct EngineGame *meta     = &engine->games[client->game];
+    for (size_t i = 0; i < meta->nb_clients; i++) {
+        if (meta->clients[i] == socket) {
+            meta->clients[i] = meta->clients[--meta->nb_clients];
+            break;
+        }
+    }
+    if (client->player != ENGINE_SPECTATOR) {
+        meta->nb_players--;
+    }
+    client->game       = ENGINE_NO_GAME;
+    client->nb_pending = 0;
+    bcast_unsubscribe(meta->broadcaster, socket);
+    evloop_del(engine->loop, socket);
+    // le prochain client qui recevra ce numéro de fd n'a encore rien négocié
+    set_protocol(socket, PROTOCOL_LEGACY);
+    sclose(socket);
+}
+
+// Note ce que le Broadcaster de la partie n'a pas encore pu envoyer et
+// détache les clients qu'il a déconnectés (trop lents ou partis).
+static void __after_broadcast(struct GameEngine *engine, int game) {
+    struct EngineGame *meta = &engine->games[game];
+    meta->backlog = bcast_flush(meta->broadcaster);
+    __update_backlogged(engine, game);
+
+    FileDescriptor gone[ENGINE_MAX_CLIENTS];
+    int nb_gone = bcast_reap(meta->broadcaster, gone, ENGINE_MAX_CLIENTS);
+    for (int i = 0; i < nb_gone; i++) {
+        engine_detach(engine, gone[i]);
+    }
+}
+
+// Cette fonction traite une commande et l'envoie aux clients de la partie.
+bool engine_command(struct GameEngine *engine, int game, enum Item player, enum Direction dir) {
+    struct EngineGame *meta = __game(engine, game);
+    struct Sink sink = sink_broadcaster(meta->broadcaster, PROTOCOL_LEGACY);
+    bool over = process_user_command_into(&engine->states[game], player, dir, &sink);
+    __after_broadcast(engine, game);
+    return over;
+}
+
+// Lit ce que 'socket' a envoyé. Renvoie false si le client s'est déconnecté.
+static bool __receive(struct EngineClient *client, FileDescriptor socket) {
+    ssize_t n = read(socket, client->pending + client->nb_pending, ENGINE_READ_SIZE - client->nb_pending);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        // la socket est non bloquante (cf. bcast_subscribe): rien à lire pour l'instant
+        return true;
+    }
+    if (n <= 0) {
+        return false;
+    }
+    client->nb_pending += (size_t) n;
+    if (client->player == ENGINE_SPECTATOR) {
+        // ce qu'envoie un spectateur est ignoré
+        client->nb_pending = 0;
+    }
+    return true;
+}
+
+// Retire la prochaine commande complète reçue de 'client'. Renvoie false s'il n'y en a pas.
+static bool __next_command(struct EngineClient *client, enum Direction *dir) {
+    uint32_t raw;
+    do {
+        if (client->nb_pending < sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&raw, client->pending, sizeof(uint32_t));
+        client->nb_pending -= sizeof(uint32_t);
+        memmove(client->pending, client->pending + sizeof(uint32_t), client->nb_pending);
+        // une direction inconnue (un client bogué ou malveillant) est ignorée
+    } while (raw > UP);
+    *dir = (enum Direction) raw;
+    return true;
+}
+
+// Traite toutes les commandes reçues pour la partie 'game' (une commande de
+// chaque joueur à tour de role) et les envoie d'un coup à tous ses clients.
+static size_t __play(struct GameEngine *engine, int game) {
+    struct EngineGame *meta = &engine->games[game];
+    // les messages de toutes les commandes partent d'un coup (cf. flush_sink)
+    struct Sink sink = sink_broadcaster(meta->broadcaster, PROTOCOL_LEGACY);
+    sink.deferred = true;
+    size_t count  = 0;
+    bool   more   = true;
+    while (more) {
+        more = false;
+        for (size_t i = 0; i < meta->nb_clients; i++) {
+            struct EngineClient *client = &engine->clients[meta->clients[i]];
+            enum Direction dir;
+            if (__next_command(client, &dir)) {
+                process_user_command_into(&engine->states[game], client->player, dir, &sink);
+                count++;
+                more = true;
+            }
+        }
+    }
+    flush_sink(&sink);
+    meta->touched = false;
+    __after_broadcast(engine, game);
+    return count;
+}
+
+// Cette fonction attend et traite les commandes des clients.
+size_t engine_poll(struct GameEngine *engine, int timeout) {
+    int nb_ready = evloop_wait(engine->loop, engine->ready, timeout);
+
+    // 1. on lit tout ce qui est disponible et on note les parties concernées
+    size_t nb_touched = 0;
+    for (int i = 0; i < nb_ready; i++) {
+        FileDescriptor socket = engine->ready[i];
+        struct EngineClient *client = &engine->clients[socket];
+        int game = client->game;
+        if (!__receive(client, socket)) {
+            engine_detach(engine, socket);
+            continue;
+        }
+        if (client->nb_pending >= sizeof(uint32_t) && !engine->games[game].touched) {
+            engine->games[game].touched = true;
+            engine->touched[nb_touched++] = game;
+        }
+    }
+
+    // 2. chaque partie traite ses commandes et envoie ses messages d'un bloc
+    size_t count = 0;
+    for (size_t i = 0; i < nb_touched; i++) {
+        count += __play(engine, engine->touched[i]);
+    }
+
+    // 3. on essaie d'envoyer ce qui n'a pas encore pu l'etre aux clients lents
+    //    (à l'envers: une partie qui n'a plus de backlog est remplacée dans la
+    //    liste par la dernière, qui a déjà été traitée)
+    for (size_t i = engine->nb_backlogged; i-- > 0;) {
+        __after_broadcast(engine, engine->backlogged[i]);
+    }
+    return count;
+}
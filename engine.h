@@ -0,0 +1,164 @@
+#ifndef __ENGINE__
+#define __ENGINE__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "utils_v3.h"
+
+// Ce module permet à un seul processus d'héberger un grand nombre de parties
+// indépendantes (plutot qu'un ensemble de processus par partie, comme avec
+// fork_and_run et la mémoire partagée).
+//
+// - Les GameState de toutes les parties sont stockées de manière contigue
+//   (une 'slab' allouée une fois pour toutes à la création du moteur). Une
+//   partie est identifiée par son indice dans ce tableau.
+// - Chaque partie connait les sockets de ses clients (un par joueur, plus 
+//   d'éventuels spectateurs). Les messages générés par une partie ne sont
+//   envoyés qu'à ses clients.
+// - Toutes les sockets sont surveillées par une seule EventLoop (cf. utils_v3.h):
+//   une commande lue sur une socket est envoyée à la partie de son client.
+// - Les commandes d'une même partie lues lors d'un meme appel à engine_poll
+//   sont traitées d'un bloc. Leurs messages sont encodés une seule fois et
+//   envoyés sans bloquer à tous les clients de la partie (cf. Broadcaster dans
+//   utils_v3.h): un client trop lent est déconnecté plutot que de ralentir
+//   toutes les parties.
+//
+// NOTE: Les clients du moteur parlent tous PROTOCOL_LEGACY: les messages d'une
+//       partie sont encodés une seule fois pour tous ses clients.
+
+// Identifiant renvoyé quand aucune partie n'a pu etre créée.
+#define ENGINE_NO_GAME (-1)
+
+// Le nombre maximum d'octets lus d'un coup sur une socket (soit 16 commandes).
+// Cela borne le nombre de messages qu'une partie génère lors d'un engine_poll.
+#define ENGINE_READ_SIZE (16 * sizeof(uint32_t))
+
+// Le nombre maximum de spectateurs d'une partie.
+#define ENGINE_MAX_SPECTATORS 8
+
+// Le nombre maximum de clients (joueurs et spectateurs) d'une partie.
+#define ENGINE_MAX_CLIENTS (MAX_PLAYERS + ENGINE_MAX_SPECTATORS)
+
+// Le nombre maximum d'octets en attente pour un client: au-delà, il est 
+// considéré comme trop lent et déconnecté.
+#define ENGINE_MAX_BACKLOG (64 * 1024)
+
+// Le 'joueur' d'un spectateur.
+#define ENGINE_SPECTATOR ((enum Item) 0)
+
+// Les informations du moteur sur un client (indexées par fd).
+struct EngineClient
+{
+    // La partie du client (ENGINE_NO_GAME si le fd n'est pas un client).
+    int game;
+    // Le joueur contrôlé par le client (PLAYER1, PLAYER2, ... ou ENGINE_SPECTATOR).
+    enum Item player;
+    // Les octets lus qui ne forment pas encore une commande complète.
+    uint8_t pending[ENGINE_READ_SIZE];
+    size_t  nb_pending;
+};
+
+// Les informations du moteur sur une partie (hors GameState).
+struct EngineGame
+{
+    // La partie est-elle utilisée ?
+    bool in_use;
+    // La partie a-t-elle des commandes à traiter lors de l'engine_poll en cours ?
+    bool touched;
+    // La prochaine partie libre (si celle-ci est libre).
+    int next_free;
+    // Les sockets des clients de la partie, dont 'nb_players' joueurs.
+    FileDescriptor clients[ENGINE_MAX_CLIENTS];
+    size_t nb_clients;
+    size_t nb_players;
+    // Le Broadcaster qui envoie les messages de la partie à ses clients, et
+    // le nombre d'octets qu'il n'a pas encore pu envoyer.
+    struct Broadcaster *broadcaster;
+    size_t backlog;
+    // La place de la partie dans GameEngine.backlogged (-1 si elle n'y est pas).
+    int backlog_slot;
+};
+
+struct GameEngine
+{
+    // Le nombre maximum de parties et le nombre de parties en cours.
+    size_t capacity;
+    size_t nb_games;
+    // La slab: l'état de chaque partie (capacity éléments contigus).
+    struct GameState *states;
+    // Les métadonnées de chaque partie (capacity éléments).
+    struct EngineGame *games;
+    // La première partie libre (ENGINE_NO_GAME si toutes sont utilisées).
+    int free_list;
+    // Les clients, indexés par fd (de 0 à max_fd exclu).
+    struct EngineClient *clients;
+    int max_fd;
+    // L'EventLoop qui surveille toutes les sockets des clients.
+    struct EventLoop *loop;
+    int *ready;
+    // Les parties qui ont des commandes à traiter lors de l'engine_poll en cours.
+    int *touched;
+    // Les parties dont le Broadcaster n'a pas encore tout envoyé (backlog > 0):
+    // engine_poll ne réessaie d'envoyer que pour elles.
+    int *backlogged;
+    size_t nb_backlogged;
+};
+
+// Cette fonction crée un moteur capable d'héberger 'capacity' parties en meme
+// temps, dont les clients ont des fd compris entre 0 et 'max_fd' (exclu).
+struct GameEngine *engine_create(size_t capacity, int max_fd);
+
+// Cette fonction termine toutes les parties (cf. engine_end_game) et libère le moteur.
+void engine_free(struct GameEngine *engine);
+
+// Cette fonction crée une nouvelle partie dont l'état initial est une copie de
+// 'initial' (typiquement la GameState produite par load_map, ou celle d'une map
+// compilée). Elle renvoie l'identifiant de la partie, ou ENGINE_NO_GAME si le
+// moteur est plein.
+int engine_new_game(struct GameEngine *engine, const struct GameState *initial);
+
+// Cette fonction termine la partie 'game': ses clients sont détachés (et leurs
+// sockets fermées) et sa place peut etre réutilisée par une nouvelle partie.
+void engine_end_game(struct GameEngine *engine, int game);
+
+// Renvoie l'état de la partie 'game'.
+struct GameState *engine_state(struct GameEngine *engine, int game);
+
+// Cette fonction ajoute à la partie 'game' le client connecté sur 'socket', qui
+// controle le joueur 'player' (PLAYER1, PLAYER2, ... jusqu'au nombre de joueurs
+// de la partie, cf. GameState.nb_players). Le client est enregistré et
+// reçoit l'état courant de la partie (cf. send_state), puis le moteur surveille
+// 'socket' pour y lire ses commandes (des enum Direction sur 4 octets).
+//
+// NOTE: Le moteur devient propriétaire de 'socket': c'est lui qui la ferme.
+void engine_attach(struct GameEngine *engine, int game, FileDescriptor socket, enum Item player);
+
+// Cette fonction ajoute à la partie 'game' un spectateur connecté sur 'socket':
+// il reçoit l'état courant de la partie (cf. send_state) puis tous ses messages,
+// mais ce qu'il envoie est ignoré.
+//
+// NOTE: Le moteur devient propriétaire de 'socket': c'est lui qui la ferme.
+void engine_watch(struct GameEngine *engine, int game, FileDescriptor socket);
+
+// Cette fonction retire 'socket' de sa partie, et la ferme.
+void engine_detach(struct GameEngine *engine, FileDescriptor socket);
+
+// Cette fonction traite immédiatement une commande du joueur 'player' de la
+// partie 'game' et envoie les messages générés à tous les clients de la partie.
+//
+// Cette fonction renvoie 'true' si la partie est terminée, false sinon.
+bool engine_command(struct GameEngine *engine, int game, enum Item player, enum Direction dir);
+
+// Cette fonction attend (au plus 'timeout' millisecondes, cf. evloop_wait) que
+// des clients envoient des commandes, puis les traite et envoie les messages
+// générés aux clients de chaque partie concernée. Les clients qui se sont
+// déconnectés (ou qui sont trop lents) sont détachés.
+//
+// Elle renvoie le nombre de commandes qui ont été traitées.
+size_t engine_poll(struct GameEngine *engine, int timeout);
+
+#endif //__ENGINE__
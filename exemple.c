@@ -7,6 +7,7 @@
 #include "utils_v3.h"
 #include "pascman.h"
 #include "game.h"
+#include "recorder.h"
 
 // ********************************************************************************
 // CE PROGRAMME VOUS EST FOURNI A TITRE D'EXEMPLE. IL VOUS PERMET DE COMPRENDRE
@@ -20,14 +21,31 @@
 // MODULARISE ALORS QU'IL EST ATTENDU QUE VOTRE CODE SOIT CORRECTEMENT 
 // DECOUPE EN MODULES.
 // ********************************************************************************
+// Usage: ./exemple [partie.rec]
+//        Si un fichier est donné, la partie y est enregistrée (cf. recorder.h)
+//        et peut ensuite etre rejouée avec l'outil 'replay'.
+// ********************************************************************************
+
+// Traite la commande du joueur 'player' et l'enregistre dans 'rec' (s'il y en a un).
+static bool play(struct GameState *state, struct Recorder *rec, enum Item player, enum Direction dir, FileDescriptor sout) {
+    if (rec != NULL) {
+        rec_command(rec, player, dir, cmdq_now());
+    }
+    return process_user_command(state, player, dir, sout);
+}
 
 int main(int argc, char** argv) {
     struct GameState state;
     FileDescriptor sout = 1;
     FileDescriptor map  = sopen("./resources/map.txt", O_RDONLY, 0);
-    load_map(map, sout, &state);
+    size_t map_len;
+    char *map_data = readFileToBuffer(map, &map_len);
+    load_map_from_buffer(map_data, map_len, sout, &state);
     sclose(map);
 
+    struct Recorder *rec = argc > 1 ? rec_open(argv[1], map_data, map_len) : NULL;
+    free(map_data);
+
     // Dans cet exemple, nos deux joueurs vont simplement faire un
     // petit tour sur la carte, ce qui va créer une animation un
     // peu idiote mais qui devrait permettre aux étudiants de 
@@ -62,8 +80,8 @@ int main(int argc, char** argv) {
     for(int i = 0; i < nb_tours * 10; i++) {
         usleep(500000);
         
-        process_user_command(&state, PLAYER1, tour[step_p1], sout);
-        process_user_command(&state, PLAYER2, tour[step_p2], sout);
+        play(&state, rec, PLAYER1, tour[step_p1], sout);
+        play(&state, rec, PLAYER2, tour[step_p2], sout);
         
         // on passe au pas suivant dans notre tour.
         step_p1 = (step_p1 + 1) % tour_len;
@@ -75,9 +93,13 @@ int main(int argc, char** argv) {
     // qui a mangé toute la nourriture (1 food et 1 superfood)
     // c'est lui qui a gagné le jeu.
     for (int i = 0; i < 4; i++) {
-        process_user_command(&state, PLAYER1, LEFT, sout);
+        play(&state, rec, PLAYER1, LEFT, sout);
         usleep(500000);
     }
 
+    if (rec != NULL) {
+        rec_close(rec, &state);
+    }
+
     return 0;
 }
@@ -2,6 +2,8 @@
 #include <string.h>
 
 #include "utils_v3.h"
+#include "protocol.h"
+#include "sink.h"
 
 #include "game.h"
 
@@ -14,47 +16,256 @@
 // d'une resource qui se trouve à une position donnée sur la carte.
 //
 // Cette fonction renvoie -1 en cas d'erreur
-int32_t id(uint32_t x, uint32_t y, enum Item item);
+int32_t id(const struct GameState *state, uint32_t x, uint32_t y, enum Item item);
 
 // Cette fonction utilitaire permet de connaitre l'identifiant 
 // d'une resource qui se trouve à une position donnée sur la carte.
 //
 // Cette fonction renvoie -1 en cas d'erreur
-int32_t id_at(struct Position pos, enum Item item);
+int32_t id_at(const struct GameState *state, struct Position pos, enum Item item);
 
 // Cette fonction utilitaire permet de connaitre l'offset d'une 
 // position dans la carte.
-size_t position2index(struct Position pos);
+size_t position2index(const struct GameState *state, struct Position pos);
 
 // Cette fonction ecrit le message approprié pour signifier aux clients qu'une 
 // resource donnée est introduite dans le jeu.
-void send_spawn_item(uint32_t x, uint32_t y, enum Item item, FileDescriptor fdbcast);
+void send_spawn_item(const struct GameState *state, uint32_t x, uint32_t y, enum Item item, struct Sink *sink);
 // Cette fonction ecrit le message approprié pour signifier aux clients qu'un 
 // des joueurs a bougé sur le plateau de jeu.
-void send_player_moved(enum Item player, struct Position to, FileDescriptor fdbcast);
+void send_player_moved(const struct GameState *state, enum Item player, struct Position to, struct Sink *sink);
 // Cette fonction ecrit le message approprié pour signifier aux clients que
 // de la nourriture ou superfood a été mangée par un joueur.
-void send_eat_food(enum Item player, enum Item food, struct Position to, FileDescriptor fdbcast);
+void send_eat_food(const struct GameState *state, enum Item player, enum Item food, struct Position to, struct Sink *sink);
 // Cette fonction ecrit le message approprié pour signifier aux clients que
 // la partie est terminée.
-void send_game_over(enum Item winner, FileDescriptor fdbcast);
+void send_game_over(enum Item winner, struct Sink *sink);
+// Cette fonction ecrit le message SNAPSHOT qui annonce l'état de 'state' (et
+// les messages SCORE qui le suivent).
+void send_snapshot(const struct GameState *state, struct Sink *sink);
+// Cette fonction ecrit le message BOARD qui annonce les dimensions de la map de 'state'.
+void send_board(const struct GameState *state, struct Sink *sink);
 
 /******************************************************************************************
  * FIN DU PSEUDO-HEADER.
  ******************************************************************************************/
 
-// Renvoie le début du range d'id pour ce type d'items.
-static uint32_t __base_id(enum Item item) {
+// Taille du buffer de diffusion. Une map génère au plus deux messages par case
+// (+ un GAME_OVER), ce qui permet d'envoyer toute une map de taille par défaut
+// en un seul write (une plus grande map part en plusieurs, cf. __emit).
+#define BCAST_BUFFER_SIZE ((2 * MAP_SIZE + 1) * sizeof(union Message))
+
+// Le buffer dans lequel les messages destinés à un sink SINK_FD, SINK_FANOUT ou
+// SINK_BROADCASTER sont encodés avant d'être envoyés.
+static struct WriteBuffer __bcast = { .fd = -1, .data = NULL };
+// Le sink auquel sont destinés les messages de la diffusion en cours (NULL si aucun).
+static struct Sink *__bound = NULL;
+// Les statistiques de la diffusion en cours.
+static struct BroadcastStats __pending = { 0 };
+// La valeur de __bcast.nb_syscalls au début de la diffusion en cours.
+static size_t __syscalls_before = 0;
+// Les statistiques de la dernière diffusion terminée.
+static struct BroadcastStats __last = { 0 };
+// Le cumul des statistiques de toutes les diffusions terminées.
+static struct BroadcastStats __total = { 0 };
+
+// Termine la diffusion en cours et met les statistiques à jour.
+static void __end_broadcast(void) {
+    if (__pending.messages > 0) {
+        __pending.syscalls = __bcast.nb_syscalls - __syscalls_before;
+        __last = __pending;
+        __total.messages += __pending.messages;
+        __total.bytes    += __pending.bytes;
+        __total.syscalls += __pending.syscalls;
+    }
+    __pending = (struct BroadcastStats) { 0 };
+    __syscalls_before = __bcast.nb_syscalls;
+}
+
+// Envoie au sink de la diffusion en cours les messages encodés dans __bcast.
+static void __deliver(void) {
+    if (__bound == NULL || __bcast.length == 0) {
+        return;
+    }
+    if (__bound->kind == SINK_FANOUT) {
+        __pending.bytes += __bcast.length * __bound->nb_fds;
+        wbuf_flush_to(&__bcast, __bound->fds, __bound->nb_fds);
+    } else if (__bound->kind == SINK_BROADCASTER) {
+        // une seule copie (dans un SharedBuffer), quel que soit le nombre d'abonnés
+        struct Broadcaster *bc = __bound->broadcaster;
+        size_t syscalls = bc->nb_syscalls;
+        __pending.bytes += __bcast.length * bc->nb_subscribers;
+        bcast_publish(bc, __bcast.data, __bcast.length);
+        __bcast.nb_syscalls += bc->nb_syscalls - syscalls;
+        __bcast.length = 0;
+    } else {
+        __pending.bytes += __bcast.length;
+        __bcast.fd = __bound->fd;
+        wbuf_flush(&__bcast);
+    }
+}
+
+// Termine la diffusion en cours: les messages en attente sont envoyés.
+static void __flush(void) {
+    __deliver();
+    __end_broadcast();
+    __bound = NULL;
+}
+
+// Fait en sorte que les messages suivants soient destinés à 'sink'. Si des 
+// messages destinés à un autre sink sont en attente, ceux-ci sont d'abord envoyés.
+static void __bind(struct Sink *sink) {
+    if (__bcast.data == NULL) {
+        wbuf_init(&__bcast, -1, BCAST_BUFFER_SIZE);
+    }
+    if (__bound != sink) {
+        __flush();
+        __bound = sink;
+    }
+}
+
+// Le protocole utilisé sur chaque fd (PROTOCOL_LEGACY par défaut). La table
+// grandit avec le plus grand fd qui a négocié un autre protocole.
+static enum Protocol *__protocols   = NULL;
+static size_t         __nb_protocols = 0;
+
+// Cette fonction choisit le protocole avec lequel les messages écrits sur 'fd' sont encodés.
+void set_protocol(FileDescriptor fd, enum Protocol protocol) {
+    checkCond(fd < 0, "Error: invalid fd");
+    if ((size_t) fd >= __nb_protocols) {
+        if (protocol == PROTOCOL_LEGACY) {
+            // c'est déjà le protocole de ce fd
+            return;
+        }
+        size_t nb = __nb_protocols == 0 ? 64 : __nb_protocols;
+        while (nb <= (size_t) fd) {
+            nb *= 2;
+        }
+        __protocols = realloc(__protocols, nb * sizeof(enum Protocol));
+        checkNull(__protocols, "Error REALLOC");
+        for (size_t i = __nb_protocols; i < nb; i++) {
+            __protocols[i] = PROTOCOL_LEGACY;
+        }
+        __nb_protocols = nb;
+    }
+    __protocols[fd] = protocol;
+}
+
+// Renvoie le protocole avec lequel les messages écrits sur 'fd' sont encodés.
+enum Protocol get_protocol(FileDescriptor fd) {
+    return fd >= 0 && (size_t) fd < __nb_protocols ? __protocols[fd] : PROTOCOL_LEGACY;
+}
+
+// Envoie un message (encodé selon le protocole du sink) dans le sink.
+static void __emit(struct Sink *sink, const union Message *msg) {
+    __bind(sink);
+
+    size_t len = 0;
+    switch (sink->kind) {
+    case SINK_NULL:
+        // rien à encoder
+        break;
+    case SINK_BUFFER:
+        // le message est encodé directement dans le buffer du sink
+        len = encode_message(msg, sink->protocol, sink_buffer_reserve(sink, MAX_ENCODED_MESSAGE_SIZE));
+        sink->length    += len;
+        __pending.bytes += len;
+        break;
+    case SINK_FD:
+    case SINK_FANOUT:
+    case SINK_BROADCASTER:
+        if (__bcast.capacity - __bcast.length < MAX_ENCODED_MESSAGE_SIZE) {
+            __deliver();
+        }
+        len = encode_message(msg, sink->protocol, (uint8_t *) __bcast.data + __bcast.length);
+        __bcast.length += len;
+        break;
+    }
+    __pending.messages += 1;
+    sink->messages     += 1;
+    sink->bytes        += len;
+}
+
+// Cette fonction envoie dans le sink une suite de messages deja encodés.
+void broadcast_messages_into(const union Message *msgs, size_t count, struct Sink *sink) {
+    if (sink->protocol != PROTOCOL_LEGACY || (sink->kind != SINK_FD && sink->kind != SINK_BUFFER)) {
+        // les messages doivent être réencodés (ou comptés) un à un
+        for (size_t i = 0; i < count; i++) {
+            __emit(sink, &msgs[i]);
+        }
+        flush_broadcast();
+        return;
+    }
+
+    size_t len = count * sizeof(union Message);
+    __bind(sink);
+    if (sink->kind == SINK_BUFFER) {
+        sink_buffer_append(sink, msgs, len);
+        __pending.bytes += len;
+    } else {
+        // pas de copie dans le buffer: les messages sont écrits depuis 'msgs'
+        __bcast.fd = sink->fd;
+        __pending.bytes += __bcast.length + len;
+        wbuf_write_direct(&__bcast, msgs, len);
+    }
+    __pending.messages += count;
+    sink->messages     += count;
+    sink->bytes        += len;
+    flush_broadcast();
+}
+
+// Cette fonction ajoute un message à ceux qui sont en attente pour 'sink'.
+void send_message_into(const union Message *msg, struct Sink *sink) {
+    __emit(sink, msg);
+}
+
+// Cette fonction envoie sur le fdbcast une suite de messages deja encodés.
+void broadcast_messages(const union Message *msgs, size_t count, FileDescriptor fdbcast) {
+    struct Sink sink = sink_fd(fdbcast);
+    broadcast_messages_into(msgs, count, &sink);
+}
+
+// Cette fonction envoie tous les messages qui sont encore en attente dans le
+// buffer de diffusion (sauf s'ils sont destinés à un sink 'deferred').
+struct BroadcastStats flush_broadcast(void) {
+    if (__bound != NULL && __bound->deferred) {
+        // les messages restent en attente jusqu'à l'appel de flush_sink
+        return __last;
+    }
+    __flush();
+    return __last;
+}
+
+// Cette fonction envoie les messages en attente pour le sink 'sink'.
+struct BroadcastStats flush_sink(struct Sink *sink) {
+    if (__bound == sink) {
+        __flush();
+    }
+    return __last;
+}
+
+// Renvoie les statistiques de la dernière diffusion.
+struct BroadcastStats last_broadcast_stats(void) {
+    return __last;
+}
+
+// Renvoie le cumul des statistiques de toutes les diffusions.
+struct BroadcastStats total_broadcast_stats(void) {
+    return __total;
+}
+
+// Renvoie le début du range d'id pour ce type d'items sur une map de 'cells' cases.
+static uint32_t __base_id(size_t cells, enum Item item) {
+    if (IS_PLAYER(item)) {
+        return 3*cells;
+    }
     switch (item) {
     case FOOD:
     case SUPERFOOD:
         return 0;
     case WALL:
     case FLOOR:
-        return MAP_SIZE;
-    case PLAYER1:
-    case PLAYER2:
-        return 3*MAP_SIZE;
+        return cells;
     default:
         perror("The given item type is invalid");
         exit(EXIT_FAILURE);
@@ -63,25 +274,85 @@ static uint32_t __base_id(enum Item item) {
 
 // Cette fonction utilitaire permet de connaitre l'identifiant 
 // d'une resource qui se trouve à une position donnée sur la carte.
-int32_t id_at(struct Position pos, enum Item item) {
-    return id(pos.x, pos.y, item);
+int32_t id_at(const struct GameState *state, struct Position pos, enum Item item) {
+    return id(state, pos.x, pos.y, item);
 }
 
 // Cette fonction utilitaire permet de connaitre l'identifiant 
 // d'une resource qui se trouve à une position donnée sur la carte.
-int32_t id(uint32_t x, uint32_t y, enum Item item) {
-    if (item == PLAYER1) {
-        return PLAYER1_ID;
+int32_t id(const struct GameState *state, uint32_t x, uint32_t y, enum Item item) {
+    if (IS_PLAYER(item)) {
+        return PLAYER_ID(map_cells(state), PLAYER_INDEX(item));
     }
-    if (item == PLAYER2) {
-        return PLAYER2_ID;
-    }
-    return __base_id(item) + (y * WIDTH + x);
+    return __base_id(map_cells(state), item) + (y * state->width + x);
 }
 // Cette fonction utilitaire permet de connaitre l'offset d'une 
 // position dans la carte.
-size_t position2index(struct Position pos) {
-    return (size_t) (pos.y * WIDTH + pos.x);
+size_t position2index(const struct GameState *state, struct Position pos) {
+    return map_index(state, pos);
+}
+
+// Note qu'un joueur se trouve sur la case d'index 'index' (cf. map_occupied).
+static void __occupy(struct GameState *state, size_t index) {
+    state->occupied[index / 64] |= (uint64_t) 1 << (index % 64);
+}
+
+// Note que plus aucun joueur ne se trouve sur la case d'index 'index'.
+static void __vacate(struct GameState *state, size_t index) {
+    state->occupied[index / 64] &= ~((uint64_t) 1 << (index % 64));
+}
+
+// Déplace le joueur d'indice 'player_offset' de la case d'index 'from' à la
+// case 'to' (d'index 'to_index') en tenant la grille d'occupation à jour.
+static void __relocate(struct GameState *state, size_t player_offset, size_t from, size_t to_index, struct Position to) {
+    __vacate(state, from);
+    __occupy(state, to_index);
+    state->positions[player_offset] = to;
+}
+
+// Cette fonction renvoie le joueur qui gagne la partie si elle se termine maintenant.
+enum Item game_winner(const struct GameState *state) {
+    size_t winner = 0;
+    for (size_t i = 1; i < state->nb_players; i++) {
+        if (state->scores[i] >= state->scores[winner]) {
+            winner = i;
+        }
+    }
+    return PLAYER_ITEM(winner);
+}
+
+// Vide les cases de la map de 'state' (et leur grille d'occupation), selon ses
+// dimensions actuelles: le reste de la capacité n'est pas touché.
+static void __clear_map(struct GameState *state) {
+    size_t cells = map_cells(state);
+    if(!memset(state->map, 0, cells)) {
+        perror("memset map:");
+        exit(EXIT_FAILURE);
+    }
+    if(!memset(state->occupied, 0, (cells + 63) / 64 * sizeof(uint64_t))) {
+        perror("memset occupied:");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Cette fonction copie l'état 'src' dans 'dst'.
+void copy_gamestate(struct GameState *dst, const struct GameState *src) {
+    size_t cells = map_cells(src);
+    uint32_t nb  = src->nb_players;
+    // un état incohérent (ex: lu pendant une écriture, cf. shared_snapshot)
+    // ne fait jamais déborder la copie
+    cells = cells < MAP_CAPACITY ? cells : MAP_CAPACITY;
+    nb    = nb < MAX_PLAYERS ? nb : MAX_PLAYERS;
+
+    dst->width      = src->width;
+    dst->height     = src->height;
+    dst->nb_players = src->nb_players;
+    memcpy(dst->map, src->map, cells);
+    memcpy(dst->occupied, src->occupied, (cells + 63) / 64 * sizeof(uint64_t));
+    memcpy(dst->scores, src->scores, nb * sizeof(int));
+    memcpy(dst->positions, src->positions, nb * sizeof(struct Position));
+    dst->food_count = src->food_count;
+    dst->game_over  = src->game_over;
 }
 
 // Cette réinitialise un objet GameState ce qui permet de s'assurer
@@ -90,10 +361,10 @@ size_t position2index(struct Position pos) {
 void reset_gamestate(struct GameState *state) {
     state->game_over = true;
     state->food_count= 0;
-    if(!memset(state->map, 0, sizeof(state->map))) {
-        perror("memset map:");
-        exit(EXIT_FAILURE);
-    }
+    state->width     = WIDTH;
+    state->height    = HEIGHT;
+    state->nb_players= NB_PLAYERS;
+    __clear_map(state);
     if(!memset(state->positions, 0, sizeof(state->positions))) {
         perror("memset positions:");
         exit(EXIT_FAILURE);
@@ -111,71 +382,135 @@ void reset_gamestate(struct GameState *state) {
  * utiliser pour maintenir une copie l'état courant du jeu.
  */
 void load_map(FileDescriptor fdmap, FileDescriptor fdbcast, struct GameState *state) {
+    struct Sink sink = sink_fd(fdbcast);
+    load_map_into(fdmap, &sink, state);
+}
+
+// Cette fonction fait le meme travail que load_map, mais les messages sont
+// envoyés dans 'sink'.
+void load_map_into(FileDescriptor fdmap, struct Sink *sink, struct GameState *state) {
+    // on lit tout le fichier en une fois plutot que caractere par caractere
+    // (ce qui coutait un appel systeme par case de la map).
+    size_t len = 0;
+    char *data = readFileToBuffer(fdmap, &len);
+    load_map_from_buffer_into(data, len, sink, state);
+    free(data);
+}
+
+// Cette fonction fait le meme travail que load_map, mais a partir du contenu
+// du fichier de la map qui a deja ete charge en memoire.
+void load_map_from_buffer(const char *data, size_t len, FileDescriptor fdbcast, struct GameState *state) {
+    struct Sink sink = sink_fd(fdbcast);
+    load_map_from_buffer_into(data, len, &sink, state);
+}
+
+// Lit les dimensions "largeur hauteur" sur la premiere ligne de la map 'data'
+// (si elle commence par un chiffre) et les met dans 'state'. Renvoie la position
+// du premier caractere de la map proprement dite.
+static size_t __read_dimensions(const char *data, size_t len, struct GameState *state) {
+    if (len == 0 || data[0] < '0' || data[0] > '9') {
+        // pas d'entete: la map a les dimensions par défaut
+        return 0;
+    }
+
+    uint32_t dims[2] = { 0, 0 };
+    size_t i = 0;
+    for (int d = 0; d < 2; d++) {
+        while (i < len && data[i] == ' ') {
+            i++;
+        }
+        checkCond(i >= len || data[i] < '0' || data[i] > '9', "Error: invalid map header");
+        while (i < len && data[i] >= '0' && data[i] <= '9') {
+            dims[d] = dims[d] * 10 + (uint32_t) (data[i++] - '0');
+            checkCond(dims[d] > UINT16_MAX, "Error: invalid map header");
+        }
+    }
+    checkCond(dims[0] == 0 || dims[1] == 0, "Error: invalid map header");
+    checkCond(dims[0] > MAX_WIDTH || dims[1] > MAX_HEIGHT,
+              "Error: the map is larger than MAX_WIDTH x MAX_HEIGHT");
+    state->width  = dims[0];
+    state->height = dims[1];
+
+    // la map commence à la ligne suivante
+    while (i < len && data[i] != '\n') {
+        i++;
+    }
+    return i < len ? i + 1 : i;
+}
+
+// Cette fonction fait le meme travail que load_map_from_buffer, mais les 
+// messages sont envoyés dans 'sink'.
+void load_map_from_buffer_into(const char *data, size_t len, struct Sink *sink, struct GameState *state) {
     reset_gamestate(state);
+    size_t start = __read_dimensions(data, len, state);
+    if (state->width != WIDTH || state->height != HEIGHT) {
+        // reset_gamestate n'a vidé que les cases d'une map de taille par défaut
+        __clear_map(state);
+    }
 
-    size_t pos  = 0;
     uint32_t x  = 0;
     uint32_t y  = 0;
-    char c      = '\0';
-    while(sread(fdmap, &c, sizeof(char)) > 0) {
+    for (size_t i = start; i < len; i++) {
+        char c = data[i];
         // on a lu tout le fichier en une fois, maintenant on peut le parcourir charactere par
-        // charactere pour voir creer les messages nécessaires à dessiner la map. 
+        // charactere pour remplir la map. 
         // - Lorsqu'on rencontrera un caractere '#' on ajoutera un mur
         // - Lorsqu'on rencontrera un caractere '.' on ajoutera un tuile de sol et de la nourriture
         // - Lorsqu'on rencontrera un caractere '*' on ajoutera un tuile de sol et de la superfood
         // - Lorsqu'on rencontrera un caractere ' ' on ajoutera uniquement une tuile de sol.
         // - Lorsqu'on rencontrera un caractere '@' on injectera le 1er joueur
         // - Lorsqu'on rencontrera un caractere '!' on injectera le 2nd joueur
+        if (c == '\n') {
+            y ++;
+            x = 0;
+            continue;
+        }
+        if (x >= state->width || y >= state->height) {
+            // ce qui dépasse de la map est ignoré
+            continue;
+        }
+
+        size_t pos = (size_t) y * state->width + x;
         switch (c) {
             case '#': 
-                send_spawn_item(x, y, WALL, fdbcast);
                 state->map[pos] = WALL;
                 x++;
-                pos++;
                 break;
             case '.':
-                send_spawn_item(x, y, FLOOR, fdbcast);
-                send_spawn_item(x, y, FOOD, fdbcast);
                 state->map[pos] = FOOD;
                 state->food_count++;
                 x++;
-                pos++;
                 break;
             case '*':
-                send_spawn_item(x, y, FLOOR, fdbcast);
-                send_spawn_item(x, y, SUPERFOOD, fdbcast);
                 state->map[pos] = SUPERFOOD;
                 state->food_count++;
                 x++;
-                pos++;
                 break;
             case ' ':
-                send_spawn_item(x, y, FLOOR, fdbcast);
                 state->map[pos] = FLOOR;
                 x++;
-                pos++;
                 break;
             case '@':
-                send_spawn_item(x, y, PLAYER1, fdbcast); // player 1
-                send_spawn_item(x, y, FLOOR, fdbcast);
                 state->map[pos] = FLOOR;
                 state->positions[0].x = x;
                 state->positions[0].y = y;
                 x++;
-                pos++;
                 break;
             case '!':
-                send_spawn_item(x, y, PLAYER2, fdbcast); // player 2
-                send_spawn_item(x, y, FLOOR, fdbcast);
                 state->map[pos] = FLOOR;
                 state->positions[1].x = x;
                 state->positions[1].y = y;
                 x++;
-                pos++;
                 break;
-            case '\n':
-                y ++;
-                x = 0;
+            case '+':
+                // le point de départ d'un joueur supplémentaire (s'il reste de la place)
+                state->map[pos] = FLOOR;
+                if (state->nb_players < MAX_PLAYERS) {
+                    state->positions[state->nb_players].x = x;
+                    state->positions[state->nb_players].y = y;
+                    state->nb_players++;
+                }
+                x++;
                 break;
             default:
                 // par défaut on ne fait simplement rien
@@ -183,33 +518,168 @@ void load_map(FileDescriptor fdmap, FileDescriptor fdbcast, struct GameState *st
         }
     }
 
+    // la map est dessinée par morceaux de lignes (MAP_CHUNK), puis on ajoute les joueurs
+    send_map_into(state, sink);
+    for (uint32_t i = 0; i < state->nb_players; i++) {
+        __occupy(state, position2index(state, state->positions[i]));
+        send_spawn_item(state, state->positions[i].x, state->positions[i].y, PLAYER_ITEM(i), sink);
+    }
+
     if (state->food_count == 0) {
         state->game_over = true;
-        send_game_over(PLAYER1, fdbcast);
+        send_game_over(PLAYER1, sink);
     } else {
         state->game_over = false;
     }
+
+    // toute la map part en un seul write
+    flush_broadcast();
+}
+
+// Renvoie le code (cf. enum ChunkCell) qui représente l'item 'item' dans un MAP_CHUNK.
+static uint8_t __chunk_cell(enum Item item) {
+    switch (item) {
+    case FLOOR:
+        return CHUNK_FLOOR;
+    case FOOD:
+        return CHUNK_FOOD;
+    case SUPERFOOD:
+        return CHUNK_SUPERFOOD;
+    default:
+        // un mur, mais aussi une case vide (une ligne trop courte): on ne peut
+        // jamais y entrer (cf. __next_position)
+        return CHUNK_WALL;
+    }
+}
+
+// Cette fonction envoie le contenu de la map (murs, sol et nourriture) sous 
+// forme d'un message BOARD suivi de messages MAP_CHUNK: une ligne de la map
+// (jusqu'à MAP_CHUNK_CELLS cases) tient dans un message.
+void send_map(const struct GameState *state, FileDescriptor fdbcast) {
+    struct Sink sink = sink_fd(fdbcast);
+    send_map_into(state, &sink);
+    flush_broadcast();
+}
+
+// Cette fonction fait le meme travail que send_map, mais les messages sont
+// envoyés dans 'sink'.
+void send_map_into(const struct GameState *state, struct Sink *sink) {
+    send_board(state, sink);
+    uint32_t width = state->width;
+    for (uint32_t y = 0; y < state->height; y++) {
+        const uint8_t *row = state->map + (size_t) y * width;
+        for (uint32_t x0 = 0; x0 < width; x0 += MAP_CHUNK_CELLS) {
+            union Message msg = {
+                .map_chunk = {
+                    .msgt = MAP_CHUNK,
+                    .y    = y,
+                    .x    = x0,
+                    .len  = width - x0 < MAP_CHUNK_CELLS ? width - x0 : MAP_CHUNK_CELLS
+                }
+            };
+            for (uint32_t i = 0; i < msg.map_chunk.len; i++) {
+                uint8_t cell = __chunk_cell(row[x0 + i]);
+                msg.map_chunk.cells[i / 4] |= cell << (2 * (i % 4));
+            }
+            __emit(sink, &msg);
+        }
+    }
+}
+
+// Cette fonction envoie le contenu de la map (murs, sol, nourriture et joueurs)
+// avec un message SPAWN par item, comme le faisait load_map à l'origine.
+void send_map_tiles(const struct GameState *state, FileDescriptor fdbcast) {
+    struct Sink sink = sink_fd(fdbcast);
+    send_map_tiles_into(state, &sink);
+    flush_broadcast();
+}
+
+// Cette fonction fait le meme travail que send_map_tiles, mais les messages 
+// sont envoyés dans 'sink'.
+void send_map_tiles_into(const struct GameState *state, struct Sink *sink) {
+    for (uint32_t y = 0; y < state->height; y++) {
+        for (uint32_t x = 0; x < state->width; x++) {
+            enum Item item = state->map[(size_t) y * state->width + x];
+            if (map_occupied(state, (size_t) y * state->width + x)) {
+                for (uint32_t i = 0; i < state->nb_players; i++) {
+                    if (x == state->positions[i].x && y == state->positions[i].y) {
+                        send_spawn_item(state, x, y, PLAYER_ITEM(i), sink);
+                        break;
+                    }
+                }
+            }
+            switch (item) {
+            case WALL:
+                send_spawn_item(state, x, y, WALL, sink);
+                break;
+            case FLOOR:
+                send_spawn_item(state, x, y, FLOOR, sink);
+                break;
+            case FOOD:
+            case SUPERFOOD:
+                send_spawn_item(state, x, y, FLOOR, sink);
+                send_spawn_item(state, x, y, item, sink);
+                break;
+            default:
+                // case vide (la map était trop petite)
+                break;
+            }
+        }
+    }
+}
+
+// Cette fonction envoie la map et la position des joueurs de 'state' à un client
+// qui arrive en cours de partie.
+void send_state(const struct GameState *state, FileDescriptor fdbcast) {
+    struct Sink sink = sink_fd(fdbcast);
+    send_state_into(state, &sink);
+}
+
+// Cette fonction fait le meme travail que send_state, mais les messages sont
+// envoyés dans 'sink'.
+void send_state_into(const struct GameState *state, struct Sink *sink) {
+    send_snapshot(state, sink);
+    send_map_into(state, sink);
+    for (uint32_t i = 0; i < state->nb_players; i++) {
+        send_spawn_item(state, state->positions[i].x, state->positions[i].y, PLAYER_ITEM(i), sink);
+    }
+    if (state->game_over) {
+        send_game_over(game_winner(state), sink);
+    }
+    flush_broadcast();
 }
 
 // Cette fonction ecrit le message approprié pour signifier à un client qu'il est
 void send_registered(uint32_t player, FileDescriptor socket) {
+    send_registered_protocol(player, PROTOCOL_LEGACY, socket);
+}
+
+// Cette fonction ecrit le message approprié pour signifier à un client qu'il est
+// enregistré, et que les messages suivants seront encodés avec 'protocol'.
+void send_registered_protocol(uint32_t player, enum Protocol protocol, FileDescriptor socket) {
     union Message msg = {
         .registration = {
-            .msgt = REGISTRATION,
-            .player   = player
+            .msgt     = REGISTRATION,
+            .player   = player,
+            .protocol = protocol
         }
     };
 
-    swrite(socket, &msg, sizeof(union Message));
+    // le message d'enregistrement est encodé avec l'ancien protocole, 
+    // tous ceux qui le suivent avec le nouveau.
+    struct Sink sink = sink_fd(socket);
+    __emit(&sink, &msg);
+    flush_broadcast();
+    set_protocol(socket, protocol);
 }
 
 // Cette fonction ecrit le message approprié pour signifier aux clients qu'une 
 // resource donnée est introduite dans le jeu.
-void send_spawn_item(uint32_t x, uint32_t y, enum Item item, FileDescriptor fdbcast) {
+void send_spawn_item(const struct GameState *state, uint32_t x, uint32_t y, enum Item item, struct Sink *sink) {
     union Message msg = {
         .spawn = {
             .msgt = SPAWN,
-            .id   = id(x, y, item),
+            .id   = id(state, x, y, item),
             .item = item,
             .pos  = {
                 .x = x,
@@ -218,53 +688,96 @@ void send_spawn_item(uint32_t x, uint32_t y, enum Item item, FileDescriptor fdbc
         }
     };
 
-    swrite(fdbcast, &msg, sizeof(union Message));
+    __emit(sink, &msg);
 }
 
 // Cette fonction ecrit le message approprié pour signifier aux clients qu'un 
 // des joueurs a bougé sur le plateau de jeu.
-void send_player_moved(enum Item player, struct Position to, FileDescriptor fdbcast) {
+void send_player_moved(const struct GameState *state, enum Item player, struct Position to, struct Sink *sink) {
     union Message msg = {
         .movement = {
             .msgt = MOVEMENT,
-            .id   = id_at(to, player),
+            .id   = id_at(state, to, player),
             .pos  = to
         }
     };
-    swrite(fdbcast, &msg, sizeof(union Message));
+    __emit(sink, &msg);
 }
 
 // Cette fonction ecrit le message approprié pour signifier aux clients que
 // de la nourriture ou superfood a été mangée par un joueur.
-void send_eat_food(enum Item player, enum Item food, struct Position to, FileDescriptor fdbcast) {
+void send_eat_food(const struct GameState *state, enum Item player, enum Item food, struct Position to, struct Sink *sink) {
     union Message msg = {
         .eat_food = {
             .msgt  = EAT_FOOD,
-            .eater = id_at(to, player),
-            .food  = id_at(to, food),
+            .eater = id_at(state, to, player),
+            .food  = id_at(state, to, food),
         }
     };
 
-    swrite(fdbcast, &msg, sizeof(union Message));
+    __emit(sink, &msg);
 }
 
 // Cette fonction ecrit le message approprié pour signifier aux clients que
 // la partie est terminée.
-void send_game_over(enum Item winner, FileDescriptor fdbcast) {
+void send_game_over(enum Item winner, struct Sink *sink) {
     union Message msg = {
         .game_over = {
             .msgt   = GAME_OVER,
-            .winner = winner == PLAYER1 ? 1 : 2
+            .winner = (uint32_t) PLAYER_INDEX(winner) + 1
+        }
+    };
+    __emit(sink, &msg);
+}
+
+// Cette fonction renvoie le nombre de messages MAP_CHUNK envoyés par send_map.
+uint16_t map_chunk_count(const struct GameState *state) {
+    return (uint16_t) (state->height * ((state->width + MAP_CHUNK_CELLS - 1) / MAP_CHUNK_CELLS));
+}
+
+// Cette fonction ecrit le message qui annonce aux clients l'état de 'state',
+// suivi du score de chaque joueur (les MAP_CHUNK et les SPAWN des joueurs
+// suivent, cf. send_state).
+void send_snapshot(const struct GameState *state, struct Sink *sink) {
+    union Message msg = {
+        .snapshot = {
+            .msgt       = SNAPSHOT,
+            .chunks     = map_chunk_count(state),
+            .nb_players = state->nb_players,
+            .food_count = state->food_count
+        }
+    };
+    __emit(sink, &msg);
+    for (uint32_t i = 0; i < state->nb_players; i++) {
+        union Message score = {
+            .score = {
+                .msgt   = SCORE,
+                .player = i + 1,
+                .score  = (uint32_t) state->scores[i]
+            }
+        };
+        __emit(sink, &score);
+    }
+}
+
+// Cette fonction ecrit le message qui annonce aux clients les dimensions de la
+// map de 'state' (les MAP_CHUNK suivent, cf. send_map).
+void send_board(const struct GameState *state, struct Sink *sink) {
+    union Message msg = {
+        .board = {
+            .msgt   = BOARD,
+            .width  = (uint16_t) state->width,
+            .height = (uint16_t) state->height
         }
     };
-    swrite(fdbcast, &msg, sizeof(union Message));
+    __emit(sink, &msg);
 }
 
 // Cette fonction renvoie la prochaine position du joueur après
 // avoir traité le déplacement dans la direction 'dir'. Il est
 // important de noter que la position renvoyée peut être impossible
-//  à atteindre.
-static struct Position __next_position(struct Position pos, enum Direction dir) {
+//  à atteindre (sur la map de 'state').
+static struct Position __next_position(const struct GameState *state, struct Position pos, enum Direction dir) {
     struct Position next = pos;
     switch (dir) {
     case UP:
@@ -273,7 +786,7 @@ static struct Position __next_position(struct Position pos, enum Direction dir)
         }
         break;
     case DOWN:
-        if (next.y < HEIGHT-1) {
+        if (next.y < state->height - 1) {
             next.y += 1;
         }
         break;
@@ -283,7 +796,7 @@ static struct Position __next_position(struct Position pos, enum Direction dir)
         }
         break;
     case RIGHT:
-        if (next.x < WIDTH -1) {
+        if (next.x < state->width - 1) {
             next.x += 1;
         }
         break;
@@ -299,53 +812,123 @@ static struct Position __next_position(struct Position pos, enum Direction dir)
 // Par ailleurs, cette fonction renvoie 'true' si la partie est 
 // terminée, false sinon.
 bool process_user_command(struct GameState* state, enum Item player, enum Direction dir, FileDescriptor fdbcast) {
+    struct Sink sink = sink_fd(fdbcast);
+    return process_user_command_into(state, player, dir, &sink);
+}
+
+static bool __move_player(struct GameState* state, enum Item player, struct Position next, struct Sink *sink);
+
+// Cette fonction fait le meme travail que process_user_command, mais les 
+// messages sont envoyés dans 'sink'.
+bool process_user_command_into(struct GameState* state, enum Item player, enum Direction dir, struct Sink *sink) {
+    if (state->game_over) {
+        send_game_over(game_winner(state), sink);
+        flush_broadcast();
+        return true;
+    }
+
+    if (!game_has_player(state, player)) {
+        // un joueur inconnu (une commande corrompue): la commande est ignorée,
+        // les autres parties du processus continuent
+        flush_broadcast();
+        return false;
+    }
+    size_t player_offset = PLAYER_INDEX(player);
+    struct Position next = __next_position(state, state->positions[player_offset], dir);
+    return __move_player(state, player, next, sink);
+}
+
+// Cette fonction fait le meme travail que process_user_command_into, mais la
+// destination du joueur est lue dans la table 'moves' de la map.
+bool process_user_command_table_into(struct GameState* state, const struct MoveTable *moves,
+                                     enum Item player, enum Direction dir, struct Sink *sink) {
     if (state->game_over) {
-        enum Item winner = state->scores[0] > state->scores[1] ? PLAYER1 : PLAYER2;
-        send_game_over(winner, fdbcast);
+        send_game_over(game_winner(state), sink);
+        flush_broadcast();
         return true;
     }
 
-    size_t player_offset  = player == PLAYER1 ? 0 : 1;
-    struct Position next  = __next_position(state->positions[player_offset], dir);
-    struct Position other = state->positions[(player_offset + 1) % 2];
+    if (!game_has_player(state, player)) {
+        // un joueur inconnu (une commande corrompue): la commande est ignorée,
+        // les autres parties du processus continuent
+        flush_broadcast();
+        return false;
+    }
+    size_t player_offset = PLAYER_INDEX(player);
+    if (dir > UP) {
+        // une direction inconnue: le joueur reste sur place (cf. __next_position)
+        return __move_player(state, player, state->positions[player_offset], sink);
+    }
+    MapIndex to = moves->next[position2index(state, state->positions[player_offset])][dir];
+    if (to == MOVE_BLOCKED) {
+        // un mur: rien ne se passe (et rien n'est envoyé)
+        flush_broadcast();
+        return false;
+    }
+    struct Position next = { .x = to % state->width, .y = to / state->width };
+    return __move_player(state, player, next, sink);
+}
+
+// Cette fonction construit la table des déplacements de la map de 'state'.
+void build_move_table(const struct GameState *state, struct MoveTable *moves) {
+    moves->cells = map_cells(state);
+    for (uint32_t y = 0; y < state->height; y++) {
+        for (uint32_t x = 0; x < state->width; x++) {
+            struct Position pos = { .x = x, .y = y };
+            for (int dir = DOWN; dir <= UP; dir++) {
+                struct Position next = __next_position(state, pos, (enum Direction) dir);
+                size_t offset        = position2index(state, next);
+                enum Item at_next    = state->map[offset];
+                bool walkable        = at_next == FLOOR || at_next == FOOD || at_next == SUPERFOOD;
+                moves->next[position2index(state, pos)][dir] = walkable ? (MapIndex) offset : MOVE_BLOCKED;
+            }
+        }
+    }
+}
+
+// Cette fonction déplace (si c'est possible) le joueur 'player' sur la case 'next'
+// et envoie les messages qui en découlent dans 'sink'.
+static bool __move_player(struct GameState* state, enum Item player, struct Position next, struct Sink *sink) {
+    size_t player_offset = PLAYER_INDEX(player);
+    size_t offset        = position2index(state, state->positions[player_offset]);
+    size_t next_offset   = position2index(state, next);
 
-    // Si l'autre joueur se trouve sur la case destination, le jeu est fini.
-    if (next.x == other.x && next.y == other.y) {
+    // Si un autre joueur se trouve sur la case destination, le jeu est fini.
+    if (next_offset != offset && map_occupied(state, next_offset)) {
         state->game_over = true;
-        enum Item winner = state->scores[0] > state->scores[1] ? PLAYER1 : PLAYER2;
-        send_game_over(winner, fdbcast);
+        send_game_over(game_winner(state), sink);
+        flush_broadcast();
         return true;
     }
 
     // La partie n'est pas finie, il faut mettre l'état à jour et envoyer une série de messages.
-    size_t next_offset = position2index(next);
     enum Item at_next  = state->map[next_offset];
     switch (at_next) {
     case FLOOR:
-        state->positions[player_offset] = next;
-        send_player_moved(player, next, fdbcast);
+        __relocate(state, player_offset, offset, next_offset, next);
+        send_player_moved(state, player, next, sink);
         break;
     case FOOD:
         state->map[next_offset] = FLOOR;
-        state->positions[player_offset] = next;
+        __relocate(state, player_offset, offset, next_offset, next);
         state->scores[player_offset] += 1;
         state->food_count --;
         if (state->food_count == 0) {
             state->game_over = true;
         }
-        send_player_moved(player, next, fdbcast);
-        send_eat_food(player, at_next, next, fdbcast);
+        send_player_moved(state, player, next, sink);
+        send_eat_food(state, player, at_next, next, sink);
         break;
     case SUPERFOOD:
         state->map[next_offset] = FLOOR;
-        state->positions[player_offset] = next;
+        __relocate(state, player_offset, offset, next_offset, next);
         state->scores[player_offset] += 17;
         state->food_count --;
         if (state->food_count == 0) {
             state->game_over = true;
         }
-        send_player_moved(player, next, fdbcast);
-        send_eat_food(player, at_next, next, fdbcast);
+        send_player_moved(state, player, next, sink);
+        send_eat_food(state, player, at_next, next, sink);
         break;
     default:
         /* do nothing */
@@ -353,9 +936,10 @@ bool process_user_command(struct GameState* state, enum Item player, enum Direct
     }
 
     if (state->game_over) {
-        enum Item winner = state->scores[0] > state->scores[1] ? PLAYER1 : PLAYER2;
-        send_game_over(winner, fdbcast);
+        send_game_over(game_winner(state), sink);
     }
 
+    // tous les messages générés par cette commande partent en un seul write
+    flush_broadcast();
     return state->game_over;
 }
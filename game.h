@@ -6,56 +6,184 @@
 #include <stdbool.h>
 
 #include "pascman.h"
+#include "sink.h"
 
+// Le nombre de joueurs d'une partie, à moins que la map n'en prévoie plus
+// (cf. load_map et MAX_PLAYERS dans pascman.h).
 #define NB_PLAYERS 2
 
 // Tous les éléments du jeu ont un identifiant qui peut être 
 // choisi arbitrairement. Par facilité, on va opter pour le
-// schéma suivant:
+// schéma suivant (où N = width * height est le nombre de cases
+// de la map, cf. struct GameState):
 // - Les items de type FOOD et SUPERFOOD sont dans le range
-//   (0..MAP_SIZE), ce qui veut dire qu'on peut directement 
+//   (0..N), ce qui veut dire qu'on peut directement 
 //   convertir l'identifiant en position sur la map et vice
 //   versa.
 // - Les items de type WALL et FLOOR ont un identifiant dans
-//   le range (MAP_SIZE, 2*MAP_SIZE) parce qu'en fait, on 
+//   le range (N, 2*N) parce qu'en fait, on 
 //   n'aura jamais besoin de manipuler leurs id.
-// - Les itesm de type PLAYER1, PLAYER2 sont dans le range 3*MAP_SIZE
-//   et 3*MAP_SIZE + 1. Ce qui permet de connaitre immédiatement
+// - Les itesm de type PLAYER1, PLAYER2, ... sont dans le range 3*N
+//   et 3*N + MAX_PLAYERS - 1 (le joueur PLAYER_ITEM(i) a l'id 3*N + i).
+//   Ce qui permet de connaitre immédiatement
 //   l'id d'un joueur, de retrouver le joueur en fonction de
 //   son id.
-#define PLAYER1_ID (3 * MAP_SIZE)
-#define PLAYER2_ID (3 * MAP_SIZE + 1)
+// Sur une map de 30x20, on retrouve donc les memes identifiants qu'avant
+// que la taille des maps ne soit configurable (les joueurs sont 1800 et 1801).
+#define PLAYER_ID(cells, i) (3 * (cells) + (i))
+#define PLAYER1_ID(cells) PLAYER_ID(cells, 0)
+#define PLAYER2_ID(cells) PLAYER_ID(cells, 1)
 
 // Juste histoire de rendre le code plus facile à lire.
 typedef int FileDescriptor;
 
+//#############################################################################
+// DIFFUSION DES MESSAGES
+//#############################################################################
+
+// Les messages ne sont pas écrits un par un sur le fdbcast: ils sont
+// accumulés dans un buffer et envoyés en une seule fois (un seul write)
+// à la fin de load_map et de process_user_command. Cette structure
+// permet de vérifier combien d'appels systèmes une diffusion a coûté.
+struct BroadcastStats
+{
+    // Nombre de messages envoyés lors de la diffusion.
+    size_t messages;
+    // Nombre d'octets envoyés lors de la diffusion.
+    size_t bytes;
+    // Nombre d'appels à write() qui ont été nécessaires.
+    size_t syscalls;
+};
+
+// Cette fonction envoie sur le fdbcast (ou dans le sink) tous les messages qui
+// sont encore en attente dans le buffer de diffusion, sauf s'ils sont destinés
+// à un sink 'deferred' (cf. flush_sink). Elle renvoie les statistiques de la 
+// diffusion qui vient d'être terminée.
+//
+// NOTE: load_map, send_registered et process_user_command appellent 
+//       cette fonction avant de se terminer. Il n'y a donc jamais de 
+//       message en attente entre deux appels (ce qui est important si
+//       on fork).
+struct BroadcastStats flush_broadcast(void);
+
+// Renvoie les statistiques de la dernière diffusion (cf. flush_broadcast).
+struct BroadcastStats last_broadcast_stats(void);
+
+// Renvoie le cumul des statistiques de toutes les diffusions terminées depuis
+// le lancement du programme (utile pour les benchmarks).
+struct BroadcastStats total_broadcast_stats(void);
+
+// Cette fonction envoie les messages qui sont en attente pour le sink 'sink'
+// (cf. sink.h). C'est nécessaire pour un sink 'deferred', dont les messages
+// ne sont pas envoyés à la fin de chaque commande. Elle renvoie les 
+// statistiques de la diffusion.
+//
+// NOTE: Les messages d'un sink 'deferred' doivent avoir été envoyés avant 
+//       d'écrire dans un autre sink (sinon ils partent à ce moment-là).
+struct BroadcastStats flush_sink(struct Sink *sink);
+
+// Cette fonction choisit le protocole (cf. pascman.h) avec lequel tous les 
+// messages écrits sur 'fd' seront désormais encodés. Par défaut, c'est
+// PROTOCOL_LEGACY qui est utilisé. N'importe quel fd (aussi grand soit-il) peut
+// changer de protocole.
+//
+// Le protocole est attaché au numéro de fd, pas à la connexion: celui qui ferme
+// un fd dont il a changé le protocole doit d'abord le remettre à PROTOCOL_LEGACY
+// (comme le fait engine_detach), sans quoi le prochain client qui recevra ce
+// numéro de fd recevrait des messages d'un protocole qu'il n'a pas négocié.
+void set_protocol(FileDescriptor fd, enum Protocol protocol);
+
+// Cette fonction renvoie le protocole utilisé pour encoder les messages écrits sur 'fd'.
+enum Protocol get_protocol(FileDescriptor fd);
+
+// Cette fonction envoie sur le fdbcast les 'count' messages du tableau 'msgs'
+// (apres les éventuels messages en attente). Les messages sont écrits
+// directement depuis 'msgs', sans etre recopiés dans le buffer de diffusion.
+void broadcast_messages(const union Message *msgs, size_t count, FileDescriptor fdbcast);
+
+// Cette fonction fait la meme chose que broadcast_messages, mais les messages
+// sont envoyés dans 'sink'.
+void broadcast_messages_into(const union Message *msgs, size_t count, struct Sink *sink);
+
+// Cette fonction ajoute le message 'msg' à ceux qui sont en attente pour 'sink'
+// (cf. flush_broadcast et flush_sink). C'est ce que font toutes les fonctions
+// send_* de ce module: elle sert aux modules qui génèrent eux-memes leurs 
+// messages (par exemple bitboard.h).
+void send_message_into(const union Message *msg, struct Sink *sink);
+
 //#############################################################################
 // SHARED STATE (SHM)
 //#############################################################################
 
+// Le nombre de mots de 64 bits de la grille d'occupation d'une GameState.
+#define OCCUPANCY_WORDS ((MAP_CAPACITY + 63) / 64)
+
 // Il s'agit ici de l'état partagé par tous les processus
 // qui tournent sur le server. C'est lui qui sera stocké en
-// mémoire partagée.
+// mémoire partagée (cf. shared_state.h pour le lire sans sémaphore).
+//
+// Une GameState a la taille d'une map de MAP_CAPACITY cases, mais seules les
+// map_cells premières cases de 'map' (et les mots de 'occupied' qui les
+// couvrent) sont lues ou écrites: reset_gamestate, copy_gamestate et tous les
+// parcours de la map s'arretent là. Le reste n'est jamais touché, si bien
+// qu'une GameState allouée sur le tas, en mémoire partagée ou projetée depuis
+// une map compilée ne coute en mémoire physique (et en temps de chargement)
+// que ce qu'utilise sa map.
 struct GameState
 {
+    // Les dimensions de la map (au plus MAX_WIDTH x MAX_HEIGHT, cf. pascman.h).
+    uint32_t width;
+    uint32_t height;
     // Pour chaque position de la carte, on va stocker le
-    // type d'item qui se trouve à la position. Les joueurs, 
+    // type d'item (cf. enum Item) qui se trouve à la position. Les joueurs, 
     // par contre, ne sont pas stockés comme éléments de la 
     // carte: leur position est gérée à part.
     // Dans la pratique, ca nous permettra de savoir:
     // 1. Si un mouvement est possible (destionation != wall)
     // 2. Quelle food ou superfood on a mangé.
-    enum Item map[MAP_SIZE];
-    // Ce tableau stocke le score de chacun des deux joueurs.
-    int scores[NB_PLAYERS];
+    //
+    // Les cases sont rangées ligne par ligne, sans trou: la case {x, y} se trouve
+    // à l'index y * width + x (cf. map_index), quelle que soit la capacité. Un
+    // octet par case suffit, ce qui permet à une map de 30x20 de tenir dans
+    // une dizaine de lignes de cache.
+    uint8_t map[MAP_CAPACITY];
+    // La grille d'occupation de la map: le bit de la case d'index i (bit i % 64
+    // du mot i / 64) est mis si un joueur s'y trouve. Savoir si un déplacement
+    // percute un autre joueur ne demande donc qu'un test, quel que soit le
+    // nombre de joueurs (cf. map_occupied).
+    uint64_t occupied[OCCUPANCY_WORDS];
+    // Le nombre de joueurs de la partie (au plus MAX_PLAYERS).
+    uint32_t nb_players;
+    // Ce tableau stocke le score de chacun des joueurs.
+    int scores[MAX_PLAYERS];
     // Compte le nombre d'éléménts qui peuvent encore être mangés sur le plateau.
     int food_count;
-    // Ce tableau stocke la position de chacun des deux joueurs.
-    struct Position positions[NB_PLAYERS];
+    // Ce tableau stocke la position de chacun des joueurs.
+    struct Position positions[MAX_PLAYERS];
     // la partie est-elle en cours ou bien terminée ?
     bool game_over;
 };
 
+// Renvoie le nombre de cases de la map de 'state'.
+static inline size_t map_cells(const struct GameState *state) {
+    return (size_t) state->width * state->height;
+}
+
+// Renvoie l'index de la case 'pos' dans la map de 'state'.
+static inline size_t map_index(const struct GameState *state, struct Position pos) {
+    return (size_t) pos.y * state->width + pos.x;
+}
+
+// Renvoie true si un joueur se trouve sur la case d'index 'index'.
+static inline bool map_occupied(const struct GameState *state, size_t index) {
+    return (state->occupied[index / 64] >> (index % 64)) & 1;
+}
+
+// Renvoie true si 'player' est l'un des state->nb_players joueurs de la partie.
+static inline bool game_has_player(const struct GameState *state, enum Item player) {
+    return IS_PLAYER(player) && PLAYER_INDEX(player) < state->nb_players;
+}
+
 //#############################################################################
 // INITIALISATION
 //#############################################################################
@@ -65,8 +193,23 @@ struct GameState
 // (par exemple en mettant -1 partout dans le champ 'food').
 void reset_gamestate(struct GameState *state);
 
+// Cette fonction copie l'état 'src' dans 'dst' (cf. struct GameState: seules
+// les cases de la map de 'src' sont copiées). C'est ce qu'il faut utiliser
+// plutot qu'une affectation ou un memcpy de toute la structure.
+void copy_gamestate(struct GameState *dst, const struct GameState *src);
+
 // Cette fonction lit la map stockée dans le fichier 'fdmap' et génère une suite
 // de messages qui sont écrits l'un à la suite de lautre sur le pipe 'fdbcast'.
+//
+// Par défaut, une map fait WIDTH x HEIGHT cases (cf. pascman.h). Une map
+// d'une autre taille annonce ses dimensions sur sa premiere ligne, sous la
+// forme "largeur hauteur" (ex: "64 48"). Une map plus grande que MAX_WIDTH x
+// MAX_HEIGHT est refusée (le programme s'arrete).
+//
+// Le joueur 1 part de la case '@' et le joueur 2 de la case '!'. Chaque case '+'
+// (dans l'ordre de lecture) est le point de départ d'un joueur supplémentaire
+// (le joueur 3, puis 4, ... jusqu'à MAX_PLAYERS): la partie a donc NB_PLAYERS
+// joueurs, plus un par case '+'.
 // 
 // De plus, va peupler une structure de type GameState passée en parametre qui 
 // sera utilisée pour maintenir une l'état courant du jeu.
@@ -75,10 +218,66 @@ void reset_gamestate(struct GameState *state);
 //       qui doit s'en charger.
 void load_map(FileDescriptor fdmap, FileDescriptor fdbcast, struct GameState *state);
 
+// Cette fonction fait la meme chose que load_map, mais les messages sont envoyés
+// dans 'sink' (cf. sink.h) plutot que sur un fd.
+void load_map_into(FileDescriptor fdmap, struct Sink *sink, struct GameState *state);
+
+// Cette fonction fait exactement la meme chose que load_map, mais la map est
+// lue dans 'data' (le contenu du fichier de la map, de longueur 'len') plutot
+// que dans un fichier. Les messages générés et la GameState sont identiques.
+void load_map_from_buffer(const char *data, size_t len, FileDescriptor fdbcast, struct GameState *state);
+
+// Idem load_map_from_buffer, mais les messages sont envoyés dans 'sink'.
+void load_map_from_buffer_into(const char *data, size_t len, struct Sink *sink, struct GameState *state);
+
+// Cette fonction envoie sur le fdbcast le contenu de la map de 'state' (murs, sol,
+// nourriture, mais pas les joueurs) sous forme d'un message BOARD (ses
+// dimensions) suivi de messages MAP_CHUNK. Une ligne de la map de 30 cases tient
+// dans un seul message: une map de 30x20 ne pèse donc que 21 messages. C'est ce
+// qu'utilise load_map.
+void send_map(const struct GameState *state, FileDescriptor fdbcast);
+
+// Idem send_map, mais les messages sont envoyés dans 'sink'. 
+//
+// NOTE: Contrairement à send_map, cette fonction ne termine pas la diffusion:
+//       l'appelant peut encore ajouter des messages avant flush_broadcast.
+void send_map_into(const struct GameState *state, struct Sink *sink);
+
+// Cette fonction envoie sur le fdbcast le contenu de la map de 'state' (y compris
+// les joueurs) avec un message SPAWN par item. C'est beaucoup plus verbeux que 
+// send_map, mais ca reste utile pour un client qui ne comprend pas les MAP_CHUNK.
+void send_map_tiles(const struct GameState *state, FileDescriptor fdbcast);
+
+// Idem send_map_tiles, mais les messages sont envoyés dans 'sink' (et la
+// diffusion n'est pas terminée, cf. send_map_into).
+void send_map_tiles_into(const struct GameState *state, struct Sink *sink);
+
+// Cette fonction envoie sur le fdbcast tout ce qu'un client qui arrive en cours de
+// partie doit savoir, sous la forme d'un snapshot (cf. struct Snapshot dans pascman.h):
+// le message SNAPSHOT (nombre de joueurs et nourriture restante) suivi du score de
+// chaque joueur (messages SCORE), la map de 'state' (cf. send_map),
+// la position des joueurs et, si la partie est terminée, le message GAME_OVER. 
+// Cela coute toujours le meme nombre de messages, quelle que soit la durée de la
+// partie. Les messages partent en un seul write.
+void send_state(const struct GameState *state, FileDescriptor fdbcast);
+
+// Idem send_state, mais les messages sont envoyés dans 'sink'.
+void send_state_into(const struct GameState *state, struct Sink *sink);
+
+// Cette fonction renvoie le nombre de messages MAP_CHUNK envoyés par send_map
+// pour la map de 'state'.
+uint16_t map_chunk_count(const struct GameState *state);
+
 // Cette fonction ecrit le message approprié pour signifier à un client qu'il enregistré
 // et qu'il peut commencer à jouer.
 void send_registered(uint32_t player, FileDescriptor socket);
 
+// Cette fonction fait la meme chose que send_registered, mais annonce en plus au
+// client que tous les messages qui vont suivre sur 'socket' seront encodés avec le
+// protocole 'protocol' (cf. pascman.h). Typiquement, 'protocol' est le résultat de
+// negotiate_protocol (cf. protocol.h) appliqué à la version demandée par le client.
+void send_registered_protocol(uint32_t player, enum Protocol protocol, FileDescriptor socket);
+
 //#############################################################################
 // COEUR DU JEU
 //#############################################################################
@@ -86,10 +285,71 @@ void send_registered(uint32_t player, FileDescriptor socket);
 // Cette fonction traite une commande de l'utilisateur dans son 
 // intégralité. Elle calcule la position suivante du joueur, 
 // modifie l'état partagé (state) et envoie les messages nécessaires
-// sur le fdbcast.
+// sur le fdbcast. 'player' est l'un des state->nb_players joueurs
+// de la partie (cf. PLAYER_ITEM): la commande d'un autre joueur (une
+// commande corrompue) est ignorée, sans rien envoyer (cf. game_has_player).
+//
+// Si le joueur va sur la case d'un autre joueur, la partie est terminée:
+// c'est celui qui a le plus de points qui la gagne (en cas d'égalité, celui
+// des ex-aequo qui a le plus grand numéro, cf. game_winner).
 //
 // Par ailleurs, cette fonction renvoie 'true' si la partie est 
 // terminée, false sinon.
 bool process_user_command(struct GameState* state, enum Item player, enum Direction dir, FileDescriptor fdbcast);
 
+// Cette fonction fait la meme chose que process_user_command, mais les messages
+// sont envoyés dans 'sink' (cf. sink.h) plutot que sur un fd.
+bool process_user_command_into(struct GameState* state, enum Item player, enum Direction dir, struct Sink *sink);
+
+// Cette fonction renvoie le joueur qui gagne la partie 'state' si elle se
+// termine maintenant: celui qui a le plus de points (en cas d'égalité, celui des
+// ex-aequo qui a le plus grand numéro).
+enum Item game_winner(const struct GameState *state);
+
+//#############################################################################
+// TABLE DES DEPLACEMENTS
+//#############################################################################
+
+// L'index d'une case de la map (cf. map_index): sur 16 bits tant que la
+// capacité des maps le permet (ce qui divise par deux la taille des tables
+// qui en contiennent une par case), sur 32 bits sinon.
+#if MAP_CAPACITY < UINT16_MAX
+typedef uint16_t MapIndex;
+#define MAP_INDEX_NONE UINT16_MAX
+#else
+typedef uint32_t MapIndex;
+#define MAP_INDEX_NONE UINT32_MAX
+#endif
+
+// La destination d'un déplacement impossible (vers un mur) dans une MoveTable.
+#define MOVE_BLOCKED MAP_INDEX_NONE
+
+// La table des déplacements d'une map donne, pour chaque case et chaque
+// direction, l'index (cf. map_index) de la case où arrive un joueur qui
+// s'y trouve et va dans cette direction, ou MOVE_BLOCKED s'il y a un mur. Un
+// joueur qui va vers le bord de la map reste sur sa case.
+//
+// Les murs ne changent jamais pendant une partie: la table est construite une
+// fois pour toutes, au chargement de la map, et peut etre partagée par toutes
+// les parties jouées sur cette map (et par ce qui cherche des chemins sur la map).
+//
+// NOTE: la table est dimensionnée pour MAP_CAPACITY cases: avec de très grandes
+//       maps (cf. MAX_WIDTH), mieux vaut l'allouer sur le tas que sur la pile.
+struct MoveTable
+{
+    // Le nombre de cases de la map (cf. map_cells).
+    size_t cells;
+    MapIndex next[MAP_CAPACITY][4];
+};
+
+// Cette fonction construit dans 'moves' la table des déplacements de la map de
+// 'state' (typiquement la GameState produite par load_map).
+void build_move_table(const struct GameState *state, struct MoveTable *moves);
+
+// Cette fonction fait la meme chose que process_user_command_into, mais la
+// destination du joueur est lue dans 'moves', la table des déplacements de sa
+// map, plutot que d'etre calculée (et comparée aux murs) à chaque commande.
+bool process_user_command_table_into(struct GameState* state, const struct MoveTable *moves,
+                                     enum Item player, enum Direction dir, struct Sink *sink);
+
 #endif //__SERVER_SHARED__
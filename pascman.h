@@ -10,12 +10,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-/// Par définition, on considere que la map qu'on crée dans notre jeu a une
-/// dimension de 30 colonnes et 20 lignes
+/// Par défaut, on considere que la map qu'on crée dans notre jeu a une
+/// dimension de 30 colonnes et 20 lignes (cf. MAX_WIDTH pour les autres maps)
 #define WIDTH 30
 
-/// Par définition, on considere que la map qu'on crée dans notre jeu a une
-/// dimension de 30 colonnes et 20 lignes
+/// Par défaut, on considere que la map qu'on crée dans notre jeu a une
+/// dimension de 30 colonnes et 20 lignes (cf. MAX_HEIGHT pour les autres maps)
 #define HEIGHT 20
 
 /// Une map est constituée de 30 x 20 tuiles. Chacunes de ces tuiles peut etre
@@ -24,6 +24,24 @@
 /// que sur des cases qui sont du sol.
 #define MAP_SIZE (30*20)
 
+/// Une map peut aussi avoir d'autres dimensions, annoncées sur la premiere
+/// ligne de son fichier (cf. load_map dans game.h) et aux clients par le message
+/// BOARD. Elle ne peut cependant pas dépasser MAX_WIDTH colonnes et MAX_HEIGHT
+/// lignes: c'est la place que réserve le serveur pour chaque partie. Ces limites
+/// peuvent etre changées à la compilation (ex: make MAX_WIDTH=1024 MAX_HEIGHT=1024),
+/// jusqu'à 65535 (les coordonnées d'un MAP_CHUNK tiennent sur 16 bits).
+#ifndef MAX_WIDTH
+#define MAX_WIDTH 64
+#endif
+
+/// cf. MAX_WIDTH
+#ifndef MAX_HEIGHT
+#define MAX_HEIGHT 64
+#endif
+
+/// Le nombre maximum de cases d'une map.
+#define MAP_CAPACITY (MAX_WIDTH * MAX_HEIGHT)
+
 /// Lorsqu'un utilisateur utilisera les flèches de son clavier au sein de
 /// l'interface graphique, celle-ci écrira une direction (haut, bas, gauche, droite)
 /// sur la sortie standard. De cette façon, vous pourrez toujours savoir ce que
@@ -53,9 +71,23 @@ enum Item {
     FOOD      = 3, // de la nourriture - les resources que les joueures doivent collecter pour gagner
     SUPERFOOD = 4, // de la superfood qui rapporte plus de points que la nourriture normale
     PLAYER1   = 5, // le joueur 1
-    PLAYER2   = 6, // le joueur 1
+    PLAYER2   = 6, // le joueur 2
+    // ... les joueurs suivants (cf. PLAYER_ITEM), jusqu'à PLAYER1 + MAX_PLAYERS - 1
 };
 
+/// Une partie peut réunir jusqu'à MAX_PLAYERS joueurs.
+#define MAX_PLAYERS 64
+
+/// Le joueur numéro i + 1 (i = 0, ..., MAX_PLAYERS - 1) est l'item PLAYER1 + i:
+/// PLAYER_ITEM(0) == PLAYER1, PLAYER_ITEM(1) == PLAYER2, ...
+#define PLAYER_ITEM(i) ((enum Item) (PLAYER1 + (i)))
+
+/// Renvoie l'indice (à partir de 0) du joueur 'item' (cf. PLAYER_ITEM).
+#define PLAYER_INDEX(item) ((size_t) ((item) - PLAYER1))
+
+/// Renvoie true si 'item' est un joueur.
+#define IS_PLAYER(item) ((item) >= PLAYER1 && (item) < PLAYER1 + MAX_PLAYERS)
+
 /// Le type de message qui est envoyé depuis l'extérieur à notre interface de jeu
 enum MessageType {
     /// To tell the system that you've been registered with the server.
@@ -68,15 +100,54 @@ enum MessageType {
     EAT_FOOD = 3,
     /// To tell that the game is over
     GAME_OVER = 4,
+    /// To draw a whole row (or part of a row) of the map at once
+    MAP_CHUNK = 5,
+    /// To replace the whole state of the game (for a client joining late)
+    SNAPSHOT = 6,
+    /// To announce the dimensions of the map
+    BOARD = 7,
+    /// To give the score of a player (in a snapshot)
+    SCORE = 8,
 };
 
 
+/// La façon dont les messages sont encodés sur le fil.
+///
+/// - PROTOCOL_LEGACY: chaque message occupe exactement sizeof(union Message)
+///   octets (c'est la copie brute de l'union).
+/// - PROTOCOL_COMPACT_V1: chaque message commence par un octet qui donne son
+///   type, suivi de ses champs. Les entiers (identifiants, coordonnées, ...)
+///   sont encodés en varint (LEB128: 7 bits par octet, le bit de poids fort
+///   indique qu'un autre octet suit). Sur une map 30x20, x et y tiennent donc
+///   sur un octet et les identifiants sur deux.
+///     REGISTRATION: type, player, protocol
+///     SPAWN       : type, id, item (1 octet), x, y
+///     MOVEMENT    : type, id, x, y
+///     EAT_FOOD    : type, eater, food
+///     GAME_OVER   : type, winner
+///     MAP_CHUNK   : type, y, x, len, puis les (len + 3) / 4 octets de 'cells'
+///     SNAPSHOT    : type, chunks, nb_players, food_count
+///     BOARD       : type, width, height
+///     SCORE       : type, player, score
+///
+/// Le protocole est négocié au moment de l'enregistrement: le message 
+/// REGISTRATION est encodé avec le protocole en vigueur jusque là (au départ:
+/// PROTOCOL_LEGACY) et tous les messages qui le suivent utilisent le 
+/// protocole annoncé dans son champ 'protocol'.
+enum Protocol {
+    PROTOCOL_LEGACY     = 0,
+    PROTOCOL_COMPACT_V1 = 1,
+};
+
 /// Registration est le message qui sert à dire au jeu qu'on est un joueur en particulier.
 struct Registration {
     /// Ce messagetype devra toujours avoir la valeur REGISTRATION
     enum MessageType msgt;
     /// L'identifiant du joueur
     uint32_t player;
+    /// Le protocole (cf. enum Protocol) utilisé pour tous les messages qui 
+    /// suivent celui-ci. 0 (PROTOCOL_LEGACY) si on ne le précise pas.
+    uint32_t protocol;
 };
 
 /// Spawn est le message qui sert à introduire un item dans le jeu.
@@ -122,6 +193,89 @@ struct GameOver {
     uint32_t winner;
 };
 
+/// Nombre maximum de cases décrites par un seul message MAP_CHUNK.
+#define MAP_CHUNK_CELLS 32
+
+/// Le contenu d'une case de la map tel qu'il est encodé dans un MAP_CHUNK
+/// (2 bits par case).
+enum ChunkCell {
+    CHUNK_WALL      = 0, // un mur (ou une case vide de la map: on ne peut pas y aller)
+    CHUNK_FLOOR     = 1, // du sol
+    CHUNK_FOOD      = 2, // du sol sur lequel se trouve de la nourriture
+    CHUNK_SUPERFOOD = 3, // du sol sur lequel se trouve de la superfood
+};
+
+/// MapChunk est le message qui sert à dessiner d'un coup 'len' cases consécutives
+/// d'une ligne de la map (de {x, y} à {x + len - 1, y}). C'est beaucoup plus 
+/// compact que d'envoyer un SPAWN par mur, par tuile de sol et par nourriture.
+///
+/// La case {x + i, y} est décrite par les bits 2*(i%4) et 2*(i%4)+1 de l'octet
+/// cells[i/4] (cf. enum ChunkCell). La nourriture introduite par un MAP_CHUNK a
+/// pour identifiant l'index de sa case: y * largeur + x (cf. game.h et BOARD).
+struct MapChunk {
+    /// Ce messagetype devra toujours avoir la valeur MAP_CHUNK
+    enum MessageType msgt;
+    /// La ligne de la map
+    uint16_t y;
+    /// La colonne de la premiere case décrite
+    uint16_t x;
+    /// Le nombre de cases décrites (au plus MAP_CHUNK_CELLS)
+    uint16_t len;
+    uint16_t reserved;
+    /// Le contenu des cases, 2 bits par case
+    uint8_t cells[MAP_CHUNK_CELLS / 4];
+};
+
+/// Snapshot est le message qui annonce l'état complet d'une partie en cours à
+/// un client qui la rejoint (joueur ou spectateur). Plutot que de lui rejouer
+/// tout l'historique de la partie, on lui envoie ce message suivi de:
+/// 0. 'nb_players' messages SCORE, un par joueur (le score du joueur 1 d'abord);
+/// 1. le message BOARD (les dimensions de la map), puis 'chunks' messages
+///    MAP_CHUNK qui décrivent toute la map (murs, sol et nourriture qui reste);
+/// 2. un message SPAWN par joueur, à sa position actuelle;
+/// 3. le message GAME_OVER si la partie est déjà terminée.
+/// Ensuite, le client reçoit les messages de la partie comme les autres.
+///
+/// A la réception de ce message, le client oublie tout ce qu'il savait de la
+/// partie (map, nourriture et joueurs) avant d'appliquer ce qui suit.
+struct Snapshot {
+    /// Ce messagetype devra toujours avoir la valeur SNAPSHOT
+    enum MessageType msgt;
+    /// Le nombre de messages MAP_CHUNK qui suivent
+    uint16_t chunks;
+    uint16_t reserved;
+    /// Le nombre de joueurs de la partie (et donc de messages SCORE qui suivent)
+    uint32_t nb_players;
+    /// Le nombre d'éléments qui peuvent encore etre mangés sur la map
+    uint32_t food_count;
+};
+
+/// Score est le message qui donne le score d'un joueur. Il n'est envoyé qu'à la
+/// suite d'un SNAPSHOT (un par joueur): ensuite, le client tient lui-meme les
+/// scores à jour grace aux messages EAT_FOOD.
+struct Score {
+    /// Ce messagetype devra toujours avoir la valeur SCORE
+    enum MessageType msgt;
+    /// Le numéro du joueur (de 1 à nb_players, comme dans REGISTRATION)
+    uint32_t player;
+    /// Son score
+    uint32_t score;
+};
+
+/// Board est le message qui annonce les dimensions de la map. Il est envoyé juste
+/// avant les MAP_CHUNK qui la décrivent (au chargement de la map et dans un
+/// snapshot): le client peut alors dimensionner sa propre map. Toutes les
+/// positions qui suivent sont comprises entre {x: 0, y: 0} et
+/// {x: width - 1, y: height - 1}.
+struct Board {
+    /// Ce messagetype devra toujours avoir la valeur BOARD
+    enum MessageType msgt;
+    /// Le nombre de colonnes de la map
+    uint16_t width;
+    /// Le nombre de lignes de la map
+    uint16_t height;
+};
+
 /// Cette union encapsule tous les messages que vous pourriez vouloir envoyer à l'interface
 /// graphique de votre jeu depuis votre programme.
 union Message {
@@ -131,6 +285,10 @@ union Message {
     struct Movement movement;
     struct EatFood eat_food;
     struct GameOver game_over;
+    struct MapChunk map_chunk;
+    struct Snapshot snapshot;
+    struct Board board;
+    struct Score score;
 };
 
 #endif //__PASCMAN__
\ No newline at end of file
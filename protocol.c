@@ -0,0 +1,214 @@
+#include <string.h>
+
+#include "protocol.h"
+
+// Ecrit 'value' en varint (LEB128) dans 'out' et renvoie le nombre d'octets écrits.
+size_t put_varint(uint8_t *out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t) value;
+    return n;
+}
+
+// Lit un varint à la position '*pos' de 'in' et avance '*pos' en conséquence.
+int get_varint(const uint8_t *in, size_t len, size_t *pos, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= len) {
+            return FIELD_INCOMPLETE;
+        }
+        uint8_t byte = in[(*pos)++];
+        result |= (uint32_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return FIELD_OK;
+        }
+    }
+    // un uint32_t ne prend jamais plus de 5 octets
+    return FIELD_INVALID;
+}
+
+// Lit un octet à la position '*pos' de 'in' et avance '*pos' en conséquence.
+static int __get_byte(const uint8_t *in, size_t len, size_t *pos, uint32_t *value) {
+    if (*pos >= len) {
+        return FIELD_INCOMPLETE;
+    }
+    *value = in[(*pos)++];
+    return FIELD_OK;
+}
+
+// Le nombre d'octets utiles de 'cells' dans un MAP_CHUNK de 'len' cases.
+static size_t __chunk_bytes(uint32_t len) {
+    return (len + 3) / 4;
+}
+
+// Cette fonction choisit le protocole à utiliser avec un client qui annonce
+// savoir parler le protocole 'requested'.
+enum Protocol negotiate_protocol(uint32_t requested) {
+    return requested >= PROTOCOL_LATEST ? PROTOCOL_LATEST : (enum Protocol) requested;
+}
+
+// Encode 'msg' au format PROTOCOL_COMPACT_V1.
+static size_t __encode_compact(const union Message *msg, uint8_t *out) {
+    size_t n = 0;
+    out[n++] = (uint8_t) msg->msgt;
+    switch (msg->msgt) {
+    case REGISTRATION:
+        n += put_varint(out + n, msg->registration.player);
+        n += put_varint(out + n, msg->registration.protocol);
+        break;
+    case SPAWN:
+        n += put_varint(out + n, msg->spawn.id);
+        out[n++] = (uint8_t) msg->spawn.item;
+        n += put_varint(out + n, msg->spawn.pos.x);
+        n += put_varint(out + n, msg->spawn.pos.y);
+        break;
+    case MOVEMENT:
+        n += put_varint(out + n, msg->movement.id);
+        n += put_varint(out + n, msg->movement.pos.x);
+        n += put_varint(out + n, msg->movement.pos.y);
+        break;
+    case EAT_FOOD:
+        n += put_varint(out + n, msg->eat_food.eater);
+        n += put_varint(out + n, msg->eat_food.food);
+        break;
+    case GAME_OVER:
+        n += put_varint(out + n, msg->game_over.winner);
+        break;
+    case MAP_CHUNK:
+        n += put_varint(out + n, msg->map_chunk.y);
+        n += put_varint(out + n, msg->map_chunk.x);
+        n += put_varint(out + n, msg->map_chunk.len);
+        memcpy(out + n, msg->map_chunk.cells, __chunk_bytes(msg->map_chunk.len));
+        n += __chunk_bytes(msg->map_chunk.len);
+        break;
+    case SNAPSHOT:
+        n += put_varint(out + n, msg->snapshot.chunks);
+        n += put_varint(out + n, msg->snapshot.nb_players);
+        n += put_varint(out + n, msg->snapshot.food_count);
+        break;
+    case BOARD:
+        n += put_varint(out + n, msg->board.width);
+        n += put_varint(out + n, msg->board.height);
+        break;
+    case SCORE:
+        n += put_varint(out + n, msg->score.player);
+        n += put_varint(out + n, msg->score.score);
+        break;
+    }
+    return n;
+}
+
+// Décode un message au format PROTOCOL_COMPACT_V1.
+static int __decode_compact(const uint8_t *in, size_t len, union Message *msg) {
+    if (len == 0) {
+        return 0;
+    }
+
+    size_t pos = 1;
+    int res    = FIELD_OK;
+    uint32_t item = 0, y = 0, x = 0, count = 0;
+    memset(msg, 0, sizeof(union Message));
+    switch (in[0]) {
+    case REGISTRATION:
+        msg->registration.msgt = REGISTRATION;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->registration.player);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->registration.protocol);
+        break;
+    case SPAWN:
+        msg->spawn.msgt = SPAWN;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->spawn.id);
+        if (res == FIELD_OK) res = __get_byte(in, len, &pos, &item);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->spawn.pos.x);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->spawn.pos.y);
+        msg->spawn.item = (enum Item) item;
+        break;
+    case MOVEMENT:
+        msg->movement.msgt = MOVEMENT;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->movement.id);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->movement.pos.x);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->movement.pos.y);
+        break;
+    case EAT_FOOD:
+        msg->eat_food.msgt = EAT_FOOD;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->eat_food.eater);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->eat_food.food);
+        break;
+    case GAME_OVER:
+        msg->game_over.msgt = GAME_OVER;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->game_over.winner);
+        break;
+    case MAP_CHUNK:
+        msg->map_chunk.msgt = MAP_CHUNK;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &y);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &x);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &count);
+        if (res == FIELD_OK && count > MAP_CHUNK_CELLS) res = FIELD_INVALID;
+        if (res == FIELD_OK && pos + __chunk_bytes(count) > len) res = FIELD_INCOMPLETE;
+        if (res == FIELD_OK) {
+            msg->map_chunk.y   = (uint16_t) y;
+            msg->map_chunk.x   = (uint16_t) x;
+            msg->map_chunk.len = (uint16_t) count;
+            memcpy(msg->map_chunk.cells, in + pos, __chunk_bytes(count));
+            pos += __chunk_bytes(count);
+        }
+        break;
+    case SNAPSHOT:
+        msg->snapshot.msgt = SNAPSHOT;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &count);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->snapshot.nb_players);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->snapshot.food_count);
+        msg->snapshot.chunks = (uint16_t) count;
+        break;
+    case BOARD:
+        msg->board.msgt = BOARD;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &x);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &y);
+        msg->board.width  = (uint16_t) x;
+        msg->board.height = (uint16_t) y;
+        break;
+    case SCORE:
+        msg->score.msgt = SCORE;
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->score.player);
+        if (res == FIELD_OK) res = get_varint(in, len, &pos, &msg->score.score);
+        break;
+    default:
+        res = FIELD_INVALID;
+        break;
+    }
+
+    if (res == FIELD_OK) {
+        return (int) pos;
+    }
+    return res == FIELD_INCOMPLETE ? 0 : -1;
+}
+
+// Cette fonction encode le message 'msg' selon le protocole 'protocol'.
+size_t encode_message(const union Message *msg, enum Protocol protocol, uint8_t *out) {
+    switch (protocol) {
+    case PROTOCOL_COMPACT_V1:
+        return __encode_compact(msg, out);
+    case PROTOCOL_LEGACY:
+    default:
+        memcpy(out, msg, sizeof(union Message));
+        return sizeof(union Message);
+    }
+}
+
+// Cette fonction décode un message encodé selon le protocole 'protocol'.
+int decode_message(const uint8_t *in, size_t len, enum Protocol protocol, union Message *msg) {
+    switch (protocol) {
+    case PROTOCOL_COMPACT_V1:
+        return __decode_compact(in, len, msg);
+    case PROTOCOL_LEGACY:
+    default:
+        if (len < sizeof(union Message)) {
+            return 0;
+        }
+        memcpy(msg, in, sizeof(union Message));
+        return sizeof(union Message);
+    }
+}
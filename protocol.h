@@ -0,0 +1,59 @@
+#ifndef __PROTOCOL__
+#define __PROTOCOL__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pascman.h"
+
+// Ce module encode et décode les messages de pascman.h selon l'un des
+// protocoles définis par enum Protocol (cf. pascman.h pour le format).
+//
+// Le protocole PROTOCOL_LEGACY est toujours disponible: c'est celui que
+// comprennent les clients qui ne négocient rien.
+
+// Le protocole le plus récent que ce code sait parler.
+#define PROTOCOL_LATEST PROTOCOL_COMPACT_V1
+
+// Aucun message encodé (quel que soit le protocole) ne dépasse cette taille.
+#define MAX_ENCODED_MESSAGE_SIZE sizeof(union Message)
+
+// Résultats possibles de la lecture d'un champ (cf. get_varint).
+#define FIELD_OK         1
+#define FIELD_INCOMPLETE 0
+#define FIELD_INVALID    -1
+
+// Aucun varint (cf. put_varint) ne dépasse cette taille.
+#define MAX_VARINT_SIZE 5
+
+// Cette fonction écrit 'value' en varint (LEB128, cf. PROTOCOL_COMPACT_V1 dans
+// pascman.h) dans 'out', qui doit pouvoir contenir MAX_VARINT_SIZE octets.
+//
+// Elle renvoie le nombre d'octets écrits.
+size_t put_varint(uint8_t *out, uint32_t value);
+
+// Cette fonction lit un varint à la position '*pos' des 'len' octets de 'in',
+// le stocke dans 'value' et avance '*pos' en conséquence.
+//
+// Elle renvoie FIELD_OK, FIELD_INCOMPLETE si 'in' s'arrete au milieu du varint
+// ou FIELD_INVALID s'il ne tient pas sur 32 bits.
+int get_varint(const uint8_t *in, size_t len, size_t *pos, uint32_t *value);
+
+// Cette fonction choisit le protocole à utiliser avec un client qui annonce
+// savoir parler le protocole 'requested' (et toutes ses versions antérieures).
+enum Protocol negotiate_protocol(uint32_t requested);
+
+// Cette fonction encode le message 'msg' selon le protocole 'protocol' dans
+// le buffer 'out', qui doit pouvoir contenir MAX_ENCODED_MESSAGE_SIZE octets.
+//
+// Elle renvoie le nombre d'octets écrits dans 'out'.
+size_t encode_message(const union Message *msg, enum Protocol protocol, uint8_t *out);
+
+// Cette fonction décode un message encodé selon le protocole 'protocol' au
+// début des 'len' octets du buffer 'in' et le stocke dans 'msg'.
+//
+// Elle renvoie le nombre d'octets consommés, 0 si 'in' ne contient pas
+// encore un message complet, et -1 si les données sont invalides.
+int decode_message(const uint8_t *in, size_t len, enum Protocol protocol, union Message *msg);
+
+#endif //__PROTOCOL__
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "utils_v3.h"
+#include "protocol.h"
+
+#include "recorder.h"
+
+#define NS_PER_US 1000ull
+
+// FNV-1a sur 64 bits
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME        0x100000001b3ull
+
+// Renvoie l'empreinte FNV-1a des 'len' octets de 'data'.
+uint64_t map_hash(const char *data, size_t len) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Cette fonction crée le fichier 'path' et y écrit l'entete du replay.
+struct Recorder *rec_open(const char *path, const char *map, size_t len) {
+    struct Recorder *rec = smalloc(sizeof(struct Recorder));
+    FileDescriptor fd    = sopen(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    wbuf_init(&rec->wb, fd, REPLAY_BUFFER_SIZE);
+
+    struct ReplayHeader header = {
+        .magic    = REPLAY_MAGIC,
+        .version  = REPLAY_VERSION,
+        .map_hash = map_hash(map, len)
+    };
+    wbuf_write(&rec->wb, &header, sizeof(header));
+    // l'entete est écrit tout de suite: un fichier dont le serveur s'est
+    // arreté avant le premier flush reste un replay (sans commandes)
+    wbuf_flush(&rec->wb);
+    rec->last        = cmdq_now();
+    rec->nb_commands = 0;
+    return rec;
+}
+
+// Cette fonction enregistre une commande du joueur 'player'.
+void rec_command(struct Recorder *rec, enum Item player, enum Direction dir, uint64_t timestamp) {
+    // la direction n'a que 2 bits dans REPLAY_RECORD: au-delà, elle écraserait le joueur
+    checkCond(dir > UP, "Error REC_COMMAND: unknown direction");
+    // une commande qui aurait été datée avant la précédente est considérée simultanée
+    uint64_t delta = timestamp > rec->last ? (timestamp - rec->last) / NS_PER_US : 0;
+    if (delta > UINT32_MAX) {
+        delta = UINT32_MAX;
+    }
+    if (timestamp > rec->last) {
+        rec->last = timestamp;
+    }
+
+    uint8_t record[2 * MAX_VARINT_SIZE];
+    size_t n  = 0;
+    n += put_varint(record + n, REPLAY_RECORD(PLAYER_INDEX(player), dir));
+    n += put_varint(record + n, (uint32_t) delta);
+    wbuf_write(&rec->wb, record, n);
+    rec->nb_commands++;
+}
+
+// Cette fonction enregistre toutes les commandes 'cmds'.
+void rec_commands(struct Recorder *rec, const struct Command *cmds, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        rec_command(rec, cmds[i].player, cmds[i].dir, cmds[i].timestamp);
+    }
+}
+
+// Cette fonction enregistre l'état final de la partie et ferme le replay.
+void rec_close(struct Recorder *rec, const struct GameState *state) {
+    uint8_t trailer[1 + (MAX_PLAYERS + 3) * MAX_VARINT_SIZE];
+    size_t n = 0;
+    trailer[n++] = REPLAY_END;
+    n += put_varint(trailer + n, rec->nb_commands);
+    n += put_varint(trailer + n, state->nb_players);
+    for (size_t i = 0; i < state->nb_players; i++) {
+        n += put_varint(trailer + n, (uint32_t) state->scores[i]);
+    }
+    n += put_varint(trailer + n, (uint32_t) state->food_count);
+    wbuf_write(&rec->wb, trailer, n);
+
+    wbuf_flush(&rec->wb);
+    sclose(rec->wb.fd);
+    wbuf_free(&rec->wb);
+    free(rec);
+}
+
+// Cette fonction lit le replay stocké dans le fichier 'path'.
+bool replay_open(const char *path, struct Replay *replay) {
+    FileDescriptor fd = sopen(path, O_RDONLY, 0);
+    size_t length;
+    char *data = readFileToBuffer(fd, &length);
+    sclose(fd);
+
+    struct ReplayHeader header;
+    if (length < sizeof(header)) {
+        free(data);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION) {
+        free(data);
+        return false;
+    }
+
+    replay->data        = (uint8_t *) data;
+    replay->length      = length;
+    replay->pos         = sizeof(header);
+    replay->map_hash    = header.map_hash;
+    replay->time        = 0;
+    replay->nb_commands = 0;
+    replay->has_end     = false;
+    return true;
+}
+
+// Lit la fin du replay (à partir de la position courante, juste après REPLAY_END).
+static int __read_end(struct Replay *replay) {
+    uint32_t values[MAX_PLAYERS + 3];
+    size_t count = 2;
+    for (size_t i = 0; i < count; i++) {
+        int res = get_varint(replay->data, replay->length, &replay->pos, &values[i]);
+        if (res != FIELD_OK) {
+            return FIELD_INVALID;
+        }
+        if (i == 1) {
+            // le nombre de joueurs: leurs scores puis food_count suivent
+            if (values[1] > MAX_PLAYERS) {
+                return FIELD_INVALID;
+            }
+            count += values[1] + 1;
+        }
+    }
+    replay->has_end        = true;
+    replay->end_commands   = values[0];
+    replay->end_nb_players = values[1];
+    for (size_t i = 0; i < replay->end_nb_players; i++) {
+        replay->end_scores[i] = (int) values[2 + i];
+    }
+    replay->end_food_count = (int) values[count - 1];
+    return replay->pos == replay->length ? FIELD_INCOMPLETE : FIELD_INVALID;
+}
+
+// Cette fonction lit la prochaine commande du replay.
+int replay_next(struct Replay *replay, struct Command *cmd) {
+    if (replay->has_end || replay->pos >= replay->length) {
+        // plus rien à lire (la fin de la partie n'a peut-etre pas été enregistrée)
+        return FIELD_INCOMPLETE;
+    }
+
+    if (replay->data[replay->pos] == REPLAY_END) {
+        replay->pos++;
+        return __read_end(replay);
+    }
+
+    uint32_t record, delta;
+    int res = get_varint(replay->data, replay->length, &replay->pos, &record);
+    if (res == FIELD_OK) {
+        record -= 1;
+        if ((record >> 2) >= MAX_PLAYERS) {
+            return FIELD_INVALID;
+        }
+        res = get_varint(replay->data, replay->length, &replay->pos, &delta);
+    }
+    if (res != FIELD_OK) {
+        // une commande tronquée: le serveur s'est arreté pendant son écriture
+        return res == FIELD_INCOMPLETE && replay->pos == replay->length ? FIELD_INCOMPLETE : FIELD_INVALID;
+    }
+    replay->time += delta * NS_PER_US;
+    replay->nb_commands++;
+
+    cmd->player    = PLAYER_ITEM(record >> 2);
+    cmd->dir       = (enum Direction) (record & 3);
+    cmd->timestamp = replay->time;
+    return FIELD_OK;
+}
+
+// Cette fonction libère la mémoire d'un replay.
+void replay_close(struct Replay *replay) {
+    free(replay->data);
+    replay->data   = NULL;
+    replay->length = 0;
+}
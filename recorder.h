@@ -0,0 +1,134 @@
+#ifndef __RECORDER__
+#define __RECORDER__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "protocol.h"
+#include "cmdqueue.h"
+#include "utils_v3.h"
+
+// Ce module enregistre les commandes des joueurs d'une partie dans un fichier
+// (un 'replay'), pour pouvoir la rejouer plus tard (cf. l'outil 'replay'):
+// en cas de litige, ou pour l'analyser hors-ligne.
+//
+// Comme le jeu est déterministe, il suffit de garder la map de départ (en
+// fait son empreinte: la map elle-meme est dans resources/) et la suite des
+// commandes: rejouer ces commandes avec load_map + process_user_command
+// redonne exactement la meme partie et les memes messages.
+//
+//   +---------------------------+
+//   | struct ReplayHeader       |  <- dont l'empreinte de la map (FNV-1a)
+//   +---------------------------+
+//   | commande 1                |  <- le joueur et la direction (varint,
+//   | commande 2                |     cf. REPLAY_RECORD), puis le temps écoulé
+//   | ...                       |     depuis la commande précédente en µs
+//   +---------------------------+     (varint, cf. protocol.h)
+//   | REPLAY_END                |  <- 1 octet, puis en varint: le nombre de
+//   | scores, food_count        |     commandes, le nombre de joueurs, leurs
+//   +---------------------------+     scores et food_count à la fin de la partie
+//
+// Le fichier n'est jamais réécrit, seulement complété: les commandes passent
+// par une WriteBuffer (cf. utils_v3.h) et ne coutent donc un appel système que
+// toutes les REPLAY_BUFFER_SIZE octets. L'entete, lui, est écrit dès rec_open.
+// Si le serveur s'arrete avant la fin de la partie, les commandes déjà écrites
+// sur le fichier restent lisibles (mais il n'y a alors pas de scores à
+// vérifier): seules les dernières commandes, au plus REPLAY_BUFFER_SIZE octets
+// encore dans la WriteBuffer, sont perdues.
+
+// "PCMR" (Pas-Cman Match Replay)
+#define REPLAY_MAGIC   0x524d4350
+#define REPLAY_VERSION 2
+
+// La valeur (varint) qui décrit la commande 'dir' du joueur d'indice 'index'
+// (cf. PLAYER_INDEX). Elle ne vaut jamais 0: tient sur un octet jusqu'au
+// joueur 31.
+#define REPLAY_RECORD(index, dir) ((((uint32_t) (index)) << 2 | (uint32_t) (dir)) + 1)
+
+// L'octet qui remplace une commande pour annoncer la fin du replay.
+#define REPLAY_END 0x00
+
+// La taille de la WriteBuffer d'un Recorder.
+#define REPLAY_BUFFER_SIZE 4096
+
+// L'entete d'un fichier de replay.
+struct ReplayHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // L'empreinte (cf. map_hash) du fichier de la map sur laquelle la partie a été jouée.
+    uint64_t map_hash;
+};
+
+// Un replay en cours d'enregistrement.
+struct Recorder
+{
+    struct WriteBuffer wb;
+    // Le moment (en ns, cf. cmdq_now) de la dernière commande enregistrée.
+    uint64_t last;
+    // Le nombre de commandes enregistrées.
+    uint32_t nb_commands;
+};
+
+// Un replay en cours de lecture.
+struct Replay
+{
+    // Le contenu du fichier et la position de la prochaine commande.
+    uint8_t *data;
+    size_t   length;
+    size_t   pos;
+    // L'empreinte de la map de la partie.
+    uint64_t map_hash;
+    // Le moment de la dernière commande lue (en ns depuis le début de la partie).
+    uint64_t time;
+    // Le nombre de commandes lues.
+    uint32_t nb_commands;
+    // Une fois le replay lu jusqu'au bout: la fin de la partie a-t-elle été
+    // enregistrée et, si oui, le nombre de commandes, le nombre de joueurs,
+    // leurs scores et la nourriture restante à la fin de la partie.
+    bool has_end;
+    uint32_t end_commands;
+    uint32_t end_nb_players;
+    int end_scores[MAX_PLAYERS];
+    int end_food_count;
+};
+
+// Renvoie l'empreinte (FNV-1a sur 64 bits) des 'len' octets de 'data'.
+uint64_t map_hash(const char *data, size_t len);
+
+// Cette fonction crée le fichier 'path' et y commence le replay d'une partie
+// jouée sur la map dont le contenu (le fichier texte) est 'map' ('len' octets).
+// Les commandes enregistrées ensuite sont datées par rapport à maintenant.
+struct Recorder *rec_open(const char *path, const char *map, size_t len);
+
+// Cette fonction enregistre une commande du joueur 'player' reçue au moment
+// 'timestamp' (en ns, cf. cmdq_now). 'dir' doit etre une direction connue
+// (de DOWN à UP): le programme s'arrete sinon.
+void rec_command(struct Recorder *rec, enum Item player, enum Direction dir, uint64_t timestamp);
+
+// Cette fonction enregistre toutes les commandes 'cmds' (cf. cmdq_pop_batch).
+void rec_commands(struct Recorder *rec, const struct Command *cmds, size_t count);
+
+// Cette fonction termine le replay: l'état final de la partie 'state' est
+// enregistré (pour pouvoir vérifier le replay), le fichier est fermé et 'rec'
+// est libéré.
+void rec_close(struct Recorder *rec, const struct GameState *state);
+
+// Cette fonction lit le replay stocké dans le fichier 'path'. Elle renvoie
+// false si ce n'est pas un replay (ou pas un replay de cette version).
+bool replay_open(const char *path, struct Replay *replay);
+
+// Cette fonction lit la prochaine commande du replay et la stocke dans 'cmd'
+// (son timestamp est le temps écoulé depuis le début de la partie, en ns).
+//
+// Elle renvoie FIELD_OK, FIELD_INCOMPLETE (cf. protocol.h) quand il n'y a plus de
+// commande, ou FIELD_INVALID si le fichier est corrompu.
+int replay_next(struct Replay *replay, struct Command *cmd);
+
+// Cette fonction libère la mémoire d'un replay.
+void replay_close(struct Replay *replay);
+
+#endif //__RECORDER__
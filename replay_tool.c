@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "utils_v3.h"
+#include "pascman.h"
+#include "game.h"
+#include "sink.h"
+#include "recorder.h"
+
+// ********************************************************************************
+// OUTIL HORS-LIGNE: REJOUER UNE PARTIE
+// ================================================================================
+// Rejoue une partie enregistrée par un Recorder (cf. recorder.h) sur sa map:
+// load_map puis process_user_command pour chaque commande enregistrée.
+//
+// - Par défaut, la partie est rejouée aussi vite que possible (sans aucune
+//   pause, au contraire d'exemple.c) et les messages ne sont envoyés nulle
+//   part (cf. SINK_NULL): c'est ce qu'il faut pour vérifier une partie.
+// - Avec -g, les messages sont envoyés sur la sortie standard, comme le fait
+//   le serveur, pour revoir la partie dans l'interface graphique. Les commandes
+//   sont alors espacées comme lors de la partie, divisé par le facteur de
+//   vitesse donné par -x (2 = deux fois plus vite, 0 = sans aucune pause).
+//
+// Dans tous les cas, les scores et la nourriture restante à la fin du replay
+// sont comparés à ceux qui ont été enregistrés (le résultat est écrit sur la
+// sortie d'erreur pour ne pas se mélanger aux messages).
+//
+// Usage: ./replay [-g] [-x vitesse] partie.rec resources/map.txt
+//        ./exemple partie.rec > /dev/null  (pour enregistrer une partie)
+// ********************************************************************************
+
+#define NS_PER_SEC 1000000000ull
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Attend le moment 'start' + 'offset' ns (CLOCK_MONOTONIC).
+static void wait_until(const struct timespec *start, uint64_t offset) {
+    uint64_t total = (uint64_t) start->tv_nsec + offset;
+    struct timespec deadline = {
+        .tv_sec  = start->tv_sec + (time_t) (total / NS_PER_SEC),
+        .tv_nsec = (long) (total % NS_PER_SEC)
+    };
+    int res;
+    while ((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL)) == EINTR) {
+        // interrompu par un signal: on se rendort jusqu'à la meme échéance
+    }
+    checkCond(res != 0, "Error CLOCK_NANOSLEEP");
+}
+
+// Ecrit les scores des 'nb_players' joueurs sur la sortie d'erreur (séparés par des '/').
+static void print_scores(const int *scores, uint32_t nb_players) {
+    for (uint32_t i = 0; i < nb_players; i++) {
+        fprintf(stderr, i == 0 ? "%d" : "/%d", scores[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    bool gui     = false;
+    double speed = 1.0;
+    int first    = 1;
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-g") == 0) {
+            gui = true;
+            first += 1;
+        } else if (strcmp(argv[first], "-x") == 0 && first + 1 < argc) {
+            speed = strtod(argv[first + 1], NULL);
+            first += 2;
+        } else {
+            break;
+        }
+    }
+    if (argc - first != 2 || speed < 0) {
+        fprintf(stderr, "usage: %s [-g] [-x speed] game.rec map.txt\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *path    = argv[first];
+    const char *mappath = argv[first + 1];
+
+    struct Replay replay;
+    if (!replay_open(path, &replay)) {
+        fprintf(stderr, "%s: not a replay\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // la map doit etre exactement celle sur laquelle la partie a été jouée
+    FileDescriptor fdmap = sopen(mappath, O_RDONLY, 0);
+    size_t len;
+    char *map = readFileToBuffer(fdmap, &len);
+    sclose(fdmap);
+    if (map_hash(map, len) != replay.map_hash) {
+        fprintf(stderr, "%s: the game was not played on %s\n", path, mappath);
+        free(map);
+        replay_close(&replay);
+        return EXIT_FAILURE;
+    }
+
+    struct GameState state;
+    struct Sink sink = gui ? sink_fd(1) : sink_null();
+    load_map_from_buffer_into(map, len, &sink, &state);
+    free(map);
+    if (gui) {
+        flush_broadcast();
+        send_registered(1, 1);
+    }
+
+    struct timespec start;
+    checkNeg(clock_gettime(CLOCK_MONOTONIC, &start), "Error CLOCK_GETTIME");
+    double begin = now_sec();
+    struct Command cmd;
+    int res;
+    while ((res = replay_next(&replay, &cmd)) == FIELD_OK) {
+        if (!game_has_player(&state, cmd.player)) {
+            // un joueur qui n'est pas dans la partie enregistrée
+            res = FIELD_INVALID;
+            break;
+        }
+        if (gui && speed > 0) {
+            wait_until(&start, (uint64_t) (cmd.timestamp / speed));
+        }
+        process_user_command_into(&state, cmd.player, cmd.dir, &sink);
+    }
+    double seconds = now_sec() - begin;
+
+    fprintf(stderr, "%s: %u commands in %.6f s (%.0f commands/s), scores ",
+            path, replay.nb_commands, seconds, replay.nb_commands / seconds);
+    print_scores(state.scores, state.nb_players);
+    fprintf(stderr, ", %d food left\n", state.food_count);
+
+    bool ok = false;
+    if (res == FIELD_INVALID) {
+        fprintf(stderr, "%s: corrupted replay\n", path);
+    } else if (!replay.has_end) {
+        fprintf(stderr, "%s: the end of the game was not recorded, nothing to verify\n", path);
+    } else if (replay.end_commands   != replay.nb_commands
+            || replay.end_nb_players != state.nb_players
+            || memcmp(replay.end_scores, state.scores, state.nb_players * sizeof(int)) != 0
+            || replay.end_food_count != state.food_count) {
+        fprintf(stderr, "%s: MISMATCH, recorded %u commands, scores ", path, replay.end_commands);
+        print_scores(replay.end_scores, replay.end_nb_players);
+        fprintf(stderr, ", %d food left\n", replay.end_food_count);
+    } else {
+        fprintf(stderr, "%s: OK\n", path);
+        ok = true;
+    }
+    replay_close(&replay);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
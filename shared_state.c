@@ -0,0 +1,129 @@
+#include <string.h>
+#include <sched.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "utils_v3.h"
+
+#include "shared_state.h"
+
+// Le nombre de fois qu'un lecteur relit la version pendant une écriture avant
+// de laisser la main (l'écrivain a peut-etre été interrompu en pleine écriture).
+#define SHARED_SPINS 64
+
+// Cette fonction initialise 'shared' avec l'état 'state'.
+void shared_init(struct SharedState *shared, const struct GameState *state) {
+    atomic_init(&shared->seq, 0);
+    copy_gamestate(&shared->state, state);
+}
+
+// Cette fonction crée un segment de mémoire partagée qui contient l'état 'state'.
+int shared_shm_create(key_t key, int perm, const struct GameState *state) {
+    int shm_id = sshmget(key, sizeof(struct SharedState), IPC_CREAT | perm);
+    struct SharedState *shared = sshmat(shm_id);
+    shared_init(shared, state);
+    sshmdt(shared);
+    return shm_id;
+}
+
+// Cette fonction attache l'état contenu dans le segment 'shm_id'.
+struct SharedState *shared_shm_attach(int shm_id) {
+    return sshmat(shm_id);
+}
+
+// Cette fonction commence une écriture.
+struct GameState *shared_write_begin(struct SharedState *shared) {
+    // seul l'écrivain modifie 'seq': pas besoin d'opération atomique plus forte
+    uint64_t seq = atomic_load_explicit(&shared->seq, memory_order_relaxed);
+    atomic_store_explicit(&shared->seq, seq + 1, memory_order_relaxed);
+    // la version impaire est visible avant toute modification de l'état
+    atomic_thread_fence(memory_order_release);
+    return &shared->state;
+}
+
+// Cette fonction termine une écriture.
+void shared_write_end(struct SharedState *shared) {
+    uint64_t seq = atomic_load_explicit(&shared->seq, memory_order_relaxed);
+    // les modifications de l'état sont visibles avant la nouvelle version paire
+    atomic_store_explicit(&shared->seq, seq + 1, memory_order_release);
+}
+
+// Cette fonction remplace l'état de 'shared' par une copie de 'state'.
+void shared_publish(struct SharedState *shared, const struct GameState *state) {
+    copy_gamestate(shared_write_begin(shared), state);
+    shared_write_end(shared);
+}
+
+// Cette fonction traite des commandes directement sur l'état de 'shared'.
+bool shared_apply(struct SharedState *shared, const struct Command *cmds, size_t count, struct Sink *sink) {
+    // les messages restent en attente pendant l'écriture...
+    bool deferred  = sink->deferred;
+    sink->deferred = true;
+    struct GameState *state = shared_write_begin(shared);
+    bool over = state->game_over;
+    for (size_t i = 0; i < count; i++) {
+        over = process_user_command_into(state, cmds[i].player, cmds[i].dir, sink);
+    }
+    shared_write_end(shared);
+    sink->deferred = deferred;
+    // ... et partent une fois le nouvel état publié
+    flush_sink(sink);
+    return over;
+}
+
+// Renvoie le numéro de version de l'état publié.
+uint64_t shared_version(const struct SharedState *shared) {
+    return atomic_load_explicit(&shared->seq, memory_order_acquire) / 2;
+}
+
+// Attend qu'aucune écriture ne soit en cours et renvoie la version de l'état.
+static uint64_t __read_begin(const struct SharedState *shared) {
+    int spins = 0;
+    for (;;) {
+        uint64_t seq = atomic_load_explicit(&shared->seq, memory_order_acquire);
+        if ((seq & 1) == 0) {
+            return seq;
+        }
+        if (++spins == SHARED_SPINS) {
+            spins = 0;
+            sched_yield();
+        }
+    }
+}
+
+// Renvoie true si l'état a été modifié depuis __read_begin (qui a renvoyé 'seq'):
+// ce qui a été copié entre-temps doit alors etre relu.
+static bool __read_retry(const struct SharedState *shared, uint64_t seq) {
+    // les copies sont terminées avant de relire la version
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&shared->seq, memory_order_relaxed) != seq;
+}
+
+// Cette fonction copie dans 'out' une version cohérente de l'état de 'shared'.
+uint64_t shared_snapshot(const struct SharedState *shared, struct GameState *out) {
+    uint64_t seq;
+    do {
+        seq = __read_begin(shared);
+        copy_gamestate(out, &shared->state);
+    } while (__read_retry(shared, seq));
+    return seq / 2;
+}
+
+// Cette fonction copie dans 'out' le résumé d'une version cohérente de l'état de 'shared'.
+void shared_summary(const struct SharedState *shared, struct SharedSummary *out) {
+    const struct GameState *state = &shared->state;
+    uint64_t seq;
+    do {
+        seq = __read_begin(shared);
+        out->nb_players = state->nb_players;
+        if (out->nb_players > MAX_PLAYERS) {
+            // une copie incohérente (elle sera relue)
+            out->nb_players = MAX_PLAYERS;
+        }
+        memcpy(out->scores, state->scores, out->nb_players * sizeof(int));
+        memcpy(out->positions, state->positions, out->nb_players * sizeof(struct Position));
+        out->food_count = state->food_count;
+        out->game_over  = state->game_over;
+    } while (__read_retry(shared, seq));
+    out->version = seq / 2;
+}
@@ -0,0 +1,101 @@
+#ifndef __SHARED_STATE__
+#define __SHARED_STATE__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "cmdqueue.h"
+#include "sink.h"
+
+// Ce module place une GameState en mémoire partagée de façon à ce qu'elle
+// puisse etre lue par un nombre quelconque de processus (les broadcasters, les
+// spectateurs, les statistiques, ...) sans que ceux-ci ne prennent le sémaphore
+// de celui qui la modifie (cf. sem_down/sem_up): il s'agit d'un 'seqlock'.
+//
+// - Un seul processus (celui qui fait tourner le jeu) modifie l'état. Avant
+//   de le faire, il rend le numéro de version impair, et le rend à nouveau
+//   pair (et plus grand) quand il a fini (cf. shared_write_begin et
+//   shared_write_end). L'écrivain n'attend donc jamais personne.
+// - Un lecteur note la version, copie ce qu'il veut lire puis relit la
+//   version: si elle était impaire ou a changé entre-temps, sa copie est peut-etre
+//   incohérente et il recommence. Lire ne fait ni appel système, ni écriture
+//   en mémoire partagée (les lecteurs ne se gênent pas entre eux).
+// - Plutot que de copier toute la GameState (la map comprise, cf.
+//   shared_snapshot), un lecteur qui ne veut que les scores et les positions
+//   des joueurs peut se contenter d'une SharedSummary (cf. shared_summary).
+//
+// Un lecteur ne recommence que si l'écrivain modifie l'état pendant qu'il le
+// copie: c'est d'autant plus rare que l'écrivain garde ses sections d'écriture
+// courtes (cf. shared_apply, qui envoie les messages d'une commande une fois
+// l'état publié).
+
+struct SharedState
+{
+    // Le numéro de version de l'état: impair pendant une écriture.
+    _Alignas(64) _Atomic uint64_t seq;
+    // L'état du jeu (sur d'autres lignes de cache que 'seq').
+    _Alignas(64) struct GameState state;
+};
+
+// Ce qu'un lecteur a besoin de savoir d'une partie, sans la map.
+struct SharedSummary
+{
+    // Le numéro de version de l'état dont le résumé a été tiré.
+    uint64_t version;
+    uint32_t nb_players;
+    int scores[MAX_PLAYERS];
+    struct Position positions[MAX_PLAYERS];
+    int food_count;
+    bool game_over;
+};
+
+// Cette fonction initialise 'shared' avec l'état 'state'.
+void shared_init(struct SharedState *shared, const struct GameState *state);
+
+// Cette fonction crée un segment de mémoire partagée (de clé 'key' et de
+// permissions 'perm') qui contient l'état 'state'. Elle renvoie l'identifiant
+// du segment (cf. sshmdelete pour le supprimer).
+int shared_shm_create(key_t key, int perm, const struct GameState *state);
+
+// Cette fonction attache l'état contenu dans le segment 'shm_id' (cf. sshmdt
+// pour le détacher).
+struct SharedState *shared_shm_attach(int shm_id);
+
+// Cette fonction commence une écriture: elle renvoie l'état, que l'écrivain
+// peut alors modifier jusqu'à shared_write_end. Elle ne doit etre appelée que
+// par l'écrivain.
+struct GameState *shared_write_begin(struct SharedState *shared);
+
+// Cette fonction termine l'écriture commencée par shared_write_begin: les
+// lecteurs voient désormais le nouvel état.
+void shared_write_end(struct SharedState *shared);
+
+// Cette fonction remplace l'état de 'shared' par une copie de 'state'.
+void shared_publish(struct SharedState *shared, const struct GameState *state);
+
+// Cette fonction traite les 'count' commandes de 'cmds' (cf. cmdq_apply)
+// directement sur l'état de 'shared'. Les messages générés ne partent dans
+// 'sink' qu'une fois l'écriture terminée: les lecteurs ne sont jamais bloqués
+// par un appel système de l'écrivain.
+//
+// Elle renvoie 'true' si la partie est terminée, false sinon.
+bool shared_apply(struct SharedState *shared, const struct Command *cmds, size_t count, struct Sink *sink);
+
+// Renvoie le numéro de version de l'état publié (il augmente à chaque écriture):
+// un lecteur peut ainsi savoir si l'état a changé sans le copier.
+uint64_t shared_version(const struct SharedState *shared);
+
+// Cette fonction copie dans 'out' une version cohérente de l'état de 'shared'.
+// Elle renvoie le numéro de version de cet état.
+uint64_t shared_snapshot(const struct SharedState *shared, struct GameState *out);
+
+// Cette fonction copie dans 'out' le résumé d'une version cohérente de l'état
+// de 'shared' (cf. struct SharedSummary).
+void shared_summary(const struct SharedState *shared, struct SharedSummary *out);
+
+#endif //__SHARED_STATE__
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils_v3.h"
+#include "protocol.h"
+#include "game.h"
+
+#include "sink.h"
+
+// Renvoie un sink de type 'kind' dont tous les autres champs sont vides.
+static struct Sink __sink(enum SinkKind kind, enum Protocol protocol) {
+    struct Sink sink = {
+        .kind     = kind,
+        .protocol = protocol,
+        .deferred = false,
+        .fd       = -1,
+        .fds      = NULL,
+        .nb_fds   = 0,
+        .broadcaster = NULL,
+        .data     = NULL,
+        .length   = 0,
+        .capacity = 0,
+        .messages = 0,
+        .bytes    = 0
+    };
+    return sink;
+}
+
+// Renvoie un sink qui écrit sur 'fd'.
+struct Sink sink_fd(FileDescriptor fd) {
+    struct Sink sink = __sink(SINK_FD, get_protocol(fd));
+    sink.fd = fd;
+    return sink;
+}
+
+// Renvoie un sink qui écrit sur chacun des 'nb_fds' fds du tableau 'fds'.
+struct Sink sink_fanout(const FileDescriptor *fds, size_t nb_fds, enum Protocol protocol) {
+    struct Sink sink = __sink(SINK_FANOUT, protocol);
+    sink.fds    = fds;
+    sink.nb_fds = nb_fds;
+    return sink;
+}
+
+// Renvoie un sink qui stocke les messages dans un buffer en mémoire.
+struct Sink sink_buffer(size_t capacity, enum Protocol protocol) {
+    struct Sink sink = __sink(SINK_BUFFER, protocol);
+    sink.capacity = capacity > 0 ? capacity : MAX_ENCODED_MESSAGE_SIZE;
+    sink.data     = smalloc(sink.capacity);
+    return sink;
+}
+
+// Renvoie un sink qui envoie les messages à tous les abonnés d'un Broadcaster.
+struct Sink sink_broadcaster(struct Broadcaster *broadcaster, enum Protocol protocol) {
+    struct Sink sink = __sink(SINK_BROADCASTER, protocol);
+    sink.broadcaster = broadcaster;
+    return sink;
+}
+
+// Renvoie un sink qui compte les messages sans les garder.
+struct Sink sink_null(void) {
+    return __sink(SINK_NULL, PROTOCOL_LEGACY);
+}
+
+// Cette fonction réserve 'len' octets à la fin du buffer du sink.
+uint8_t *sink_buffer_reserve(struct Sink *sink, size_t len) {
+    checkCond(sink->kind != SINK_BUFFER, "Error: not a buffer sink");
+    if (sink->length + len > sink->capacity) {
+        while (sink->length + len > sink->capacity) {
+            sink->capacity *= 2;
+        }
+        sink->data = realloc(sink->data, sink->capacity);
+        checkNull(sink->data, "Error REALLOC");
+    }
+    return sink->data + sink->length;
+}
+
+// Cette fonction ajoute 'len' octets à la fin du buffer du sink.
+uint8_t *sink_buffer_append(struct Sink *sink, const void *data, size_t len) {
+    uint8_t *dst = sink_buffer_reserve(sink, len);
+    memcpy(dst, data, len);
+    sink->length += len;
+    return dst;
+}
+
+// Cette fonction vide le buffer du sink.
+void sink_buffer_clear(struct Sink *sink) {
+    checkCond(sink->kind != SINK_BUFFER, "Error: not a buffer sink");
+    sink->length = 0;
+}
+
+// Cette fonction libère les ressources d'un sink.
+void sink_free(struct Sink *sink) {
+    if (sink->kind == SINK_BUFFER) {
+        free(sink->data);
+        sink->data     = NULL;
+        sink->length   = 0;
+        sink->capacity = 0;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef __SINK__
+#define __SINK__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pascman.h"
+#include "utils_v3.h"
+
+// Ce module définit les destinations (sinks) vers lesquelles le jeu peut
+// envoyer ses messages (cf. les fonctions *_into de game.h). Cela permet
+// d'utiliser le meme coeur de jeu pour alimenter une socket, plusieurs
+// sockets, un fichier de replay ou un benchmark, sans pipe ni copie inutile.
+//
+// - SINK_FD:     les messages sont écrits sur un fd (en un seul write par
+//                commande ou par map, cf. flush_broadcast dans game.h).
+// - SINK_FANOUT: les messages sont encodés une seule fois et écrits sur
+//                chacun des fds d'un tableau.
+// - SINK_BUFFER: les messages sont encodés directement dans un buffer en
+//                mémoire (qui s'agrandit au besoin), sans appel système.
+// - SINK_NULL:   les messages sont comptés mais pas encodés (benchmarks).
+// - SINK_BROADCASTER: les messages sont encodés une seule fois dans un buffer
+//                partagé et envoyés sans bloquer à tous les abonnés d'un
+//                Broadcaster (cf. utils_v3.h). Un abonné trop lent ne ralentit
+//                jamais la partie.
+//
+// Un sink peut aussi etre 'deferred': les messages qui lui sont destinés ne
+// partent que lors de l'appel à flush_sink (cf. game.h) plutot qu'à la fin de
+// chaque commande. Cela permet d'envoyer le résultat de plusieurs commandes
+// en un seul write.
+
+// Juste histoire de rendre le code plus facile à lire.
+typedef int FileDescriptor;
+
+enum SinkKind {
+    SINK_FD     = 0,
+    SINK_FANOUT = 1,
+    SINK_BUFFER = 2,
+    SINK_NULL   = 3,
+    SINK_BROADCASTER = 4
+};
+
+struct Sink
+{
+    enum SinkKind kind;
+    // Le protocole avec lequel les messages sont encodés (cf. pascman.h).
+    enum Protocol protocol;
+    // Si vrai, les messages ne partent que lors de l'appel à flush_sink.
+    bool deferred;
+    // SINK_FD: le fd sur lequel les messages sont écrits.
+    FileDescriptor fd;
+    // SINK_FANOUT: les 'nb_fds' fds sur lesquels les messages sont écrits.
+    const FileDescriptor *fds;
+    size_t nb_fds;
+    // SINK_BROADCASTER: le Broadcaster à qui les messages sont envoyés.
+    struct Broadcaster *broadcaster;
+    // SINK_BUFFER: les 'length' octets reçus (dans un buffer de 'capacity' octets).
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    // Le nombre de messages et d'octets envoyés dans ce sink depuis sa création.
+    size_t messages;
+    size_t bytes;
+};
+
+// Renvoie un sink qui écrit sur 'fd', avec le protocole choisi pour ce fd (cf. get_protocol).
+struct Sink sink_fd(FileDescriptor fd);
+
+// Renvoie un sink qui écrit sur chacun des 'nb_fds' fds du tableau 'fds'. Les
+// messages sont encodés une seule fois, avec le protocole 'protocol'.
+//
+// NOTE: Le tableau n'est pas copié: il doit rester valide tant que le sink est utilisé.
+struct Sink sink_fanout(const FileDescriptor *fds, size_t nb_fds, enum Protocol protocol);
+
+// Renvoie un sink qui stocke les messages (encodés avec 'protocol') dans un buffer
+// en mémoire de 'capacity' octets au départ. Il doit etre libéré avec sink_free.
+struct Sink sink_buffer(size_t capacity, enum Protocol protocol);
+
+// Renvoie un sink qui envoie les messages (encodés avec 'protocol') à tous les
+// abonnés du Broadcaster 'broadcaster' (cf. utils_v3.h).
+struct Sink sink_broadcaster(struct Broadcaster *broadcaster, enum Protocol protocol);
+
+// Renvoie un sink qui compte les messages sans les garder.
+struct Sink sink_null(void);
+
+// Cette fonction ajoute 'len' octets (déjà encodés) à la fin du buffer d'un
+// sink de type SINK_BUFFER. Elle renvoie l'adresse où ils ont été copiés.
+uint8_t *sink_buffer_append(struct Sink *sink, const void *data, size_t len);
+
+// Cette fonction réserve 'len' octets à la fin du buffer d'un sink de type
+// SINK_BUFFER (sans changer sa longueur) et renvoie leur adresse: cela permet
+// d'y encoder un message directement.
+uint8_t *sink_buffer_reserve(struct Sink *sink, size_t len);
+
+// Cette fonction vide le buffer d'un sink de type SINK_BUFFER (sa capacité est gardée).
+void sink_buffer_clear(struct Sink *sink);
+
+// Cette fonction libère les ressources d'un sink (seul SINK_BUFFER en a).
+void sink_free(struct Sink *sink);
+
+#endif //__SINK__
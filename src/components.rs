@@ -12,6 +12,32 @@ use bracket_lib::terminal::Point;
 #[derive(Debug, Clone, Copy)]
 pub struct Player(pub u32);
 
+/// Le score de chaque joueur (celui du joueur 1 d'abord). Il est annoncé par
+/// les messages SCORE d'un SNAPSHOT, puis tenu à jour à chaque EAT_FOOD.
+#[derive(Debug, Clone, Default)]
+pub struct Scores(pub Vec<u32>);
+
+/// Ce que rapporte une nourriture (cf. process_user_command dans game.c)
+pub const FOOD_POINTS: u32 = 1;
+/// Ce que rapporte une superfood (cf. FOOD_POINTS)
+pub const SUPERFOOD_POINTS: u32 = 17;
+
+impl Scores {
+    /// Makes sure the player having the given index (0 for player 1) has a
+    /// score, which is 0 until the player eats something
+    pub fn track(&mut self, index: usize) {
+        if index >= self.0.len() {
+            self.0.resize(index + 1, 0);
+        }
+    }
+
+    /// Adds points to the score of the player having the given index
+    pub fn add(&mut self, index: usize, points: u32) {
+        self.track(index);
+        self.0[index] += points;
+    }
+}
+
 /// This component indicates that the entity is a character 
 /// (they should be rendered on top of both the map and the food)
 #[derive(Debug, Clone, Copy)]
@@ -51,10 +77,6 @@ impl Position {
     pub fn into_point(self) -> Point {
         Point::new(self.x, self.y)
     }
-
-    pub fn is_valid(self) -> bool {
-        self.x < 30 && self.y < 20
-    }
 }
 
 /// This are the stuffs on the floor which the hero is trying to eat
@@ -7,12 +7,10 @@
 //! Date:    March 2023
 //! Licence: MIT 
 
-use std::sync::mpsc::Receiver;
-
 use legion::{world::World, Resources, Schedule};
 use crate::{pascman_protocol::Item, *};
 
-use self::pascman_protocol::MessageType;
+use self::pascman_protocol::{ChunkCell, MessageType, HEIGHT, MAP_CHUNK_CELLS, WIDTH};
 
 #[derive(Debug, Clone, Copy)]
 pub enum GameStatus {
@@ -31,7 +29,7 @@ pub struct State {
 }
 
 impl State {
-    pub fn new(channel: std::sync::mpsc::Receiver<pascman_protocol::Message>) -> Self {
+    pub fn new(inbox: Inbox) -> Self {
         let ecs = World::default();
         let running = run_game_schedule();
         let over = game_over_schedule();
@@ -39,17 +37,22 @@ impl State {
         let rng = RandomNumberGenerator::new();
         resources.insert(rng);
         resources.insert(Player(0));
+        resources.insert(Scores::default());
         resources.insert(GameStatus::NotStarted);
-        resources.insert(Map{width: 30, height: 20, tiles: vec![TileType::Floor;30*20] });
-        resources.insert(channel);
+        // la map a la taille par défaut jusqu'à ce que le serveur annonce la sienne (BOARD)
+        resources.insert(Map::new(WIDTH, HEIGHT));
+        resources.insert(Entities::default());
+        resources.insert(inbox);
         Self { ecs, resources, running, over, map_file: String::new() }
     }
 
     fn process_message(
             ecs: &mut World, 
+            entities: &mut Entities,
             map: &mut Map, 
             status: &mut GameStatus, 
             player: &mut Player,
+            scores: &mut Scores,
             msg: pascman_protocol::Message
     ) {
         unsafe {
@@ -60,52 +63,103 @@ impl State {
                 },
                 MessageType::SPAWN => {
                     let spawn = msg.spawn;
-                    match spawn.item {
+                    let pos   = Position { x: spawn.pos.x as usize, y: spawn.pos.y as usize };
+                    let spawned = match spawn.item {
                         Item::FLOOR   => {
                             let idx = map.point2d_to_index(Point::new(spawn.pos.x, spawn.pos.y));
-                            map.tiles[idx] = TileType::Floor;
+                            map.set_tile(idx, TileType::Floor);
+                            None
                         },
                         Item::WALL    => {
                             let idx = map.point2d_to_index(Point::new(spawn.pos.x, spawn.pos.y));
-                            map.tiles[idx] = TileType::Wall;
-                        },
-                        Item::FOOD    => {
-                            spawn_seed(ecs, spawn.id, Position { x: spawn.pos.x as usize, y: spawn.pos.y as usize});
-                        },
-                        Item::SUPERFOOD => {
-                            spawn_superfood(ecs, spawn.id, Position { x: spawn.pos.x as usize, y: spawn.pos.y as usize});
-                        },
-                        Item::PLAYER1   => {
-                            spawn_player1(ecs, spawn.id, Position { x: spawn.pos.x as usize, y: spawn.pos.y as usize});
-                        },
-                        Item::PLAYER2   => {
-                            spawn_player2(ecs, spawn.id, Position { x: spawn.pos.x as usize, y: spawn.pos.y as usize});
+                            map.set_tile(idx, TileType::Wall);
+                            None
                         },
+                        Item::FOOD    => Some(spawn_seed(ecs, spawn.id, pos)),
+                        Item::SUPERFOOD => Some(spawn_superfood(ecs, spawn.id, pos)),
+                        item => item.player_index().map(|index| {
+                            scores.track(index as usize);
+                            spawn_player(ecs, spawn.id, index, pos)
+                        }),
+                    };
+                    if let Some(entity) = spawned {
+                        // un id déjà utilisé (ex: les joueurs sont à nouveau
+                        // annoncés par send_state) remplace l'entité précédente
+                        if let Some(previous) = entities.insert(spawn.id, entity) {
+                            ecs.remove(previous);
+                        }
                     }
                 },
                 MessageType::MOVEMENT => {
                     let mvmt = msg.movement;
                     let pos = Position{x: mvmt.pos.x as usize, y: mvmt.pos.y as usize};
-                    let entity = <(Entity, &Id)>::query()
-                        .iter(ecs)
-                        .find(|(_entity, id)| id.0 == mvmt.id)
-                        .map(|(entity, _)| *entity);
-
-                    if let Some(entity) = entity {
+                    if let Some(entity) = entities.get(mvmt.id) {
                         if let Some(mut entry) = ecs.entry(entity) {
                             entry.add_component(IntendsToMove(pos));
                         }
                     }
                 },
                 MessageType::EAT_FOOD => {
-                    let food = msg.eat_food.food;
-                    let entity = <(Entity, &Id)>::query()
-                        .iter(ecs)
-                        .find(|(_entity, id)| id.0 == food)
-                        .map(|(entity, _)| *entity);
-
-                    if let Some(entity) = entity {
+                    let eat = msg.eat_food;
+                    if let Some(entity) = entities.remove(eat.food) {
+                        let superfood = ecs.entry(entity)
+                            .map_or(false, |entry| entry.get_component::<Superfood>().is_ok());
                         ecs.remove(entity);
+                        // le joueur d'indice k a l'identifiant 3*N + k (cf. Entities)
+                        let cells = (map.width * map.height) as u32;
+                        if let Some(index) = eat.eater.checked_sub(3 * cells).filter(|i| *i < Item::MAX_PLAYERS) {
+                            scores.add(index as usize, if superfood { SUPERFOOD_POINTS } else { FOOD_POINTS });
+                        }
+                    }
+                },
+                MessageType::MAP_CHUNK => {
+                    // tout le morceau de ligne est appliqué en une passe
+                    let chunk = msg.map_chunk;
+                    let y     = chunk.y as usize;
+                    for i in 0..(chunk.len as usize).min(MAP_CHUNK_CELLS) {
+                        let x = chunk.x as usize + i;
+                        if x >= map.width || y >= map.height {
+                            break;
+                        }
+                        let idx  = y * map.width + x;
+                        let cell = chunk.cell(i);
+                        map.set_tile(idx, if cell == ChunkCell::Wall { TileType::Wall } else { TileType::Floor });
+                        let spawned = match cell {
+                            ChunkCell::Food      => Some(spawn_seed(ecs, idx as u32, Position { x, y })),
+                            ChunkCell::Superfood => Some(spawn_superfood(ecs, idx as u32, Position { x, y })),
+                            _                    => None, // rien d'autre que la tuile
+                        };
+                        if let Some(entity) = spawned {
+                            if let Some(previous) = entities.insert(idx as u32, entity) {
+                                ecs.remove(previous);
+                            }
+                        }
+                    }
+                },
+                MessageType::SNAPSHOT => {
+                    // on repart de zéro: la map, la nourriture et les joueurs
+                    // sont décrits par les messages qui suivent
+                    let snapshot = msg.snapshot;
+                    ecs.clear();
+                    entities.clear();
+                    map.fill(TileType::Wall);
+                    // les messages SCORE qui suivent donnent le score de chaque joueur
+                    let nb_players = snapshot.nb_players.min(Item::MAX_PLAYERS);
+                    *scores = Scores(vec![0; nb_players as usize]);
+                    // un spectateur n'est jamais enregistré: c'est le snapshot qui
+                    // lance la partie pour lui (GAME_OVER suit si elle est finie)
+                    *status = GameStatus::Running;
+                },
+                MessageType::BOARD => {
+                    // les MAP_CHUNK qui suivent décrivent la map à cette taille
+                    let board = msg.board;
+                    map.resize(board.width as usize, board.height as usize);
+                },
+                MessageType::SCORE => {
+                    let score = msg.score;
+                    let index = score.player.wrapping_sub(1) as usize;
+                    if let Some(value) = scores.0.get_mut(index) {
+                        *value = score.score;
                     }
                 },
                 MessageType::GAME_OVER => {
@@ -119,8 +173,8 @@ impl State {
 
 impl GameState for State {
     fn tick(&mut self, ctx: &mut bracket_lib::prelude::BTerm) {
-        ctx.set_active_console(0); // the map
-        ctx.cls();
+        // the map console (0) is not cleared: render_map only redraws the tiles
+        // which changed (see Map::take_dirty)
         ctx.set_active_console(1); // food
         ctx.cls();
         ctx.set_active_console(2); // characters
@@ -139,8 +193,11 @@ impl GameState for State {
         { // fetch messages
             let ecs = &mut self.ecs;
             let resources = &self.resources;
-            let mut rx = resources.get_mut::<Receiver<pascman_protocol::Message>>();
-            let rx = rx.as_deref_mut().unwrap();
+            let mut inbox = resources.get_mut::<Inbox>();
+            let inbox = inbox.as_deref_mut().unwrap();
+
+            let mut entities = resources.get_mut::<Entities>();
+            let entities = entities.as_deref_mut().unwrap();
 
             let mut map = resources.get_mut::<Map>();
             let map = map.as_deref_mut().unwrap();
@@ -151,8 +208,12 @@ impl GameState for State {
             let mut player = resources.get_mut::<Player>();
             let player = player.as_deref_mut().unwrap();
 
-            while let Ok(msg) = rx.try_recv() {
-                Self::process_message(ecs, map, status, player, msg);
+            let mut scores = resources.get_mut::<Scores>();
+            let scores = scores.as_deref_mut().unwrap();
+
+            // the messages of this frame (see Inbox::next_frame) are applied in one pass
+            for msg in inbox.next_frame() {
+                Self::process_message(ecs, entities, map, status, player, scores, *msg);
             }
         }
 
@@ -163,6 +224,9 @@ impl GameState for State {
             },
             GameStatus::Registered => {
                 self.ecs.clear();
+                if let Some(mut entities) = self.resources.get_mut::<Entities>() {
+                    entities.clear();
+                }
                 self.resources.insert(GameStatus::Running);
             }
             GameStatus::Running => {
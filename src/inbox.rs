@@ -0,0 +1,192 @@
+//! The inbox is where the messages sent by the server wait until the game
+//! loop applies them.
+//!
+//! - The reader thread hands the messages over in batches (one per read) on a
+//!   bounded channel. When the game loop falls behind, the reader blocks (and
+//!   so does the server writing into the pipe) instead of letting the channel
+//!   grow without limit.
+//! - The game loop applies at most `budget` messages per frame, so that a
+//!   burst never stalls a frame: the others wait for the next frames.
+//! - Among the messages applied during a frame, only the last MOVEMENT of each
+//!   entity is kept: the previous ones would be overwritten anyway (see
+//!   IntendsToMove).
+//!
+//! Licence: MIT
+
+use std::collections::{HashSet, VecDeque};
+use std::fmt;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{sync_channel, Receiver, SendError, SyncSender, TrySendError};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use crate::pascman_protocol::{Message, MessageType};
+
+/// The messages decoded from one read of the server stream: they travel
+/// together on the channel.
+pub type MessageBatch = Vec<Message>;
+
+/// How many batches may wait on the channel before the reader blocks
+pub const DEFAULT_CHANNEL_CAPACITY: usize = 256;
+
+/// How many messages are applied per frame by default (the whole map of the
+/// default size fits in one frame)
+pub const DEFAULT_MESSAGE_BUDGET: usize = 4096;
+
+/// What the reader thread and the game loop both keep track of
+#[derive(Debug, Default)]
+struct Shared {
+    /// The number of messages sent on the channel (or waiting to be) and not received yet
+    queued: AtomicUsize,
+    /// The number of times the reader found the channel full and had to wait
+    blocked_sends: AtomicU64,
+}
+
+/// Some statistics about the messages which went through the inbox
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct InboxStats {
+    /// The messages which are waiting on the channel (or for room on it)
+    pub queued: usize,
+    /// The messages which have been received but not applied yet (over budget)
+    pub pending: usize,
+    /// The messages which have been applied
+    pub applied: u64,
+    /// The MOVEMENTs which have been skipped because a later one of the same
+    /// entity was applied during the same frame
+    pub coalesced: u64,
+    /// The frames after which some messages were left for the next frames
+    pub throttled_frames: u64,
+    /// The number of times the reader had to wait because the channel was full
+    pub blocked_sends: u64,
+}
+
+impl fmt::Display for InboxStats {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "queued {} pending {} applied {} coalesced {} throttled frames {} blocked sends {}",
+            self.queued, self.pending, self.applied, self.coalesced, self.throttled_frames, self.blocked_sends)
+    }
+}
+
+/// The end of the channel used by the reader thread
+pub struct InboxSender {
+    channel: SyncSender<MessageBatch>,
+    shared : Arc<Shared>,
+}
+
+impl InboxSender {
+    /// Sends a batch of messages to the game loop. This blocks as long as the
+    /// channel is full, and fails once the game loop is gone.
+    pub fn send(&self, batch: MessageBatch) -> Result<(), SendError<MessageBatch>> {
+        let len = batch.len();
+        self.shared.queued.fetch_add(len, Ordering::Relaxed);
+        let result = match self.channel.try_send(batch) {
+            Ok(())                             => Ok(()),
+            Err(TrySendError::Full(batch))     => {
+                self.shared.blocked_sends.fetch_add(1, Ordering::Relaxed);
+                self.channel.send(batch)
+            },
+            Err(TrySendError::Disconnected(b)) => Err(SendError(b)),
+        };
+        if result.is_err() {
+            self.shared.queued.fetch_sub(len, Ordering::Relaxed);
+        }
+        result
+    }
+}
+
+/// The end of the channel used by the game loop
+pub struct Inbox {
+    channel: Receiver<MessageBatch>,
+    shared : Arc<Shared>,
+    budget : usize,
+    /// The messages received but not applied yet
+    pending: VecDeque<Message>,
+    /// The messages of the current frame (kept to reuse the allocations)
+    frame  : Vec<Message>,
+    seen   : HashSet<u32>,
+    stats  : InboxStats,
+    /// How often the statistics are written on stderr (if ever)
+    report : Option<(Duration, Instant)>,
+}
+
+/// Creates an inbox whose channel holds at most `capacity` batches and which
+/// hands at most `budget` messages per frame over to the game loop.
+pub fn inbox(capacity: usize, budget: usize) -> (InboxSender, Inbox) {
+    let (sx, rx) = sync_channel(capacity);
+    let shared   = Arc::new(Shared::default());
+    let sender   = InboxSender { channel: sx, shared: Arc::clone(&shared) };
+    let inbox    = Inbox {
+        channel: rx,
+        shared,
+        budget : budget.max(1),
+        pending: VecDeque::new(),
+        frame  : Vec::new(),
+        seen   : HashSet::new(),
+        stats  : InboxStats::default(),
+        report : None,
+    };
+    (sender, inbox)
+}
+
+impl Inbox {
+    /// Writes the statistics of the inbox on stderr every `period`
+    pub fn report_every(mut self, period: Duration) -> Self {
+        self.report = Some((period, Instant::now()));
+        self
+    }
+
+    /// Returns the statistics of the inbox
+    pub fn stats(&self) -> InboxStats {
+        InboxStats {
+            queued       : self.shared.queued.load(Ordering::Relaxed),
+            pending      : self.pending.len(),
+            blocked_sends: self.shared.blocked_sends.load(Ordering::Relaxed),
+            ..self.stats
+        }
+    }
+
+    /// Returns the messages to apply during this frame (at most `budget` of
+    /// them, in the order they were sent, stale MOVEMENTs left out)
+    pub fn next_frame(&mut self) -> &[Message] {
+        // no more than a frame's worth is taken from the channel: the rest of
+        // the backlog stays there, where it is bounded
+        while self.pending.len() < self.budget {
+            match self.channel.try_recv() {
+                Ok(batch) => {
+                    self.shared.queued.fetch_sub(batch.len(), Ordering::Relaxed);
+                    self.pending.extend(batch);
+                },
+                Err(_)    => break,
+            }
+        }
+
+        let count = self.pending.len().min(self.budget);
+        self.frame.clear();
+        self.frame.extend(self.pending.drain(..count));
+        if !self.pending.is_empty() {
+            self.stats.throttled_frames += 1;
+        }
+
+        // only the last MOVEMENT of each entity is kept
+        self.seen.clear();
+        let seen = &mut self.seen;
+        self.frame.reverse();
+        self.frame.retain(|msg| unsafe {
+            match msg.msgt {
+                MessageType::MOVEMENT => seen.insert(msg.movement.id),
+                _                     => true,
+            }
+        });
+        self.frame.reverse();
+        self.stats.coalesced += (count - self.frame.len()) as u64;
+        self.stats.applied   += self.frame.len() as u64;
+
+        if let Some((period, last)) = self.report {
+            if last.elapsed() >= period {
+                eprintln!("inbox: {}", self.stats());
+                self.report = Some((period, Instant::now()));
+            }
+        }
+        &self.frame
+    }
+}
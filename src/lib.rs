@@ -18,12 +18,15 @@ pub mod spawn;
 
 /// the external protocol to interact with the game
 pub mod pascman_protocol;
+/// how the messages of the server reach the game loop
+pub mod inbox;
 
 pub use resources::*;
 pub use components::*;
 pub use systems::*;
 pub use game_state::*;
 pub use spawn::*;
+pub use inbox::*;
 
 pub use bracket_lib::prelude::*;
 pub use legion::*;
@@ -1,33 +1,91 @@
 use std::env;
 use std::str::FromStr;
+use std::time::Duration;
 use std::{io::{stdin, Read}, thread};
 
 use legion::Schedule;
-use pas_cman_ipl::{main_loop, render_map_system, BResult, BTermBuilder, State};
+use pas_cman_ipl::pascman_protocol::{Decoder, MessageType, HEIGHT, WIDTH};
+use pas_cman_ipl::{inbox, main_loop, render_map_system, BResult, BTermBuilder, State,
+                   DEFAULT_CHANNEL_CAPACITY, DEFAULT_MESSAGE_BUDGET};
 
-fn main() -> BResult<()> {
-    let w = 30;
-    let h = 20;
+/// How many bytes the reader thread reads at once: the whole map (sent by the
+/// server in a single write) is typically decoded from one read and applied in
+/// one frame.
+const READ_BUFFER_SIZE: usize = 64 * 1024;
+
+/// How long we wait for the server to announce the dimensions of the map
+/// (BOARD message) before opening a window of the default size.
+const BOARD_TIMEOUT: Duration = Duration::from_secs(2);
 
+/// The largest window we open (in pixels): the tiles of a large map are
+/// shrunk so that the whole map fits.
+const MAX_WINDOW_WIDTH : usize = 1920;
+const MAX_WINDOW_HEIGHT: usize = 1080;
+
+fn main() -> BResult<()> {
     let resources = env::var("PAS_RESOURCES").unwrap_or(String::from_str("resources/").unwrap());
-    let (sx, rx) = std::sync::mpsc::channel();
+    // PAS_MESSAGE_BUDGET: how many messages are applied per frame at most
+    // PAS_INBOX_STATS  : every how many seconds the inbox statistics are written on stderr
+    let budget = env::var("PAS_MESSAGE_BUDGET").ok()
+        .and_then(|budget| budget.parse().ok())
+        .unwrap_or(DEFAULT_MESSAGE_BUDGET);
+    let (sx, mut rx) = inbox(DEFAULT_CHANNEL_CAPACITY, budget);
+    let report = env::var("PAS_INBOX_STATS").ok()
+        .and_then(|period| period.parse::<f64>().ok())
+        .filter(|period| *period > 0.0);
+    if let Some(period) = report {
+        rx = rx.report_every(Duration::from_secs_f64(period));
+    }
+    let (board_sx, board_rx) = std::sync::mpsc::channel();
     let mut state = State::new(rx);
     
     thread::spawn(move || {
-        let mut buffer = [0_u8; std::mem::size_of::<pas_cman_ipl::pascman_protocol::Message>()];
-        while stdin().read_exact(&mut buffer).is_ok() {
-            unsafe {
-                let message = buffer.as_mut_ptr() as *mut pas_cman_ipl::pascman_protocol::Message;
-                sx.send(*message).expect("error sending message on the channel");
+        // the messages are decoded according to the protocol which has been
+        // negotiated upon registration (legacy fixed-size framing by default)
+        // all the messages decoded from one read are sent at once on the channel
+        let mut decoder = Decoder::new();
+        let mut buffer  = vec![0_u8; READ_BUFFER_SIZE];
+        let mut input   = stdin().lock();
+        while let Ok(len) = input.read(&mut buffer) {
+            if len == 0 {
+                break;
+            }
+            decoder.feed(&buffer[..len]);
+            let mut batch = Vec::new();
+            let error = loop {
+                match decoder.next_message() {
+                    Ok(Some(message)) => {
+                        if let MessageType::BOARD = unsafe { message.msgt } {
+                            let board = unsafe { message.board };
+                            let _ = board_sx.send((board.width as usize, board.height as usize));
+                        }
+                        batch.push(message);
+                    },
+                    Ok(None)          => break None,
+                    Err(error)        => break Some(error),
+                }
+            };
+            if !batch.is_empty() {
+                sx.send(batch).expect("error sending messages on the channel");
+            }
+            if let Some(error) = error {
+                eprintln!("invalid message received: {error:?}");
+                return;
             }
         }
     });
 
+    // the consoles have the size of the map, which is only known once the server
+    // has announced it (the messages received in the meantime wait in the channel)
+    let (w, h) = board_rx.recv_timeout(BOARD_TIMEOUT).unwrap_or((WIDTH, HEIGHT));
+    drop(board_rx);
+    let tile = (MAX_WINDOW_WIDTH / w.max(1)).min(MAX_WINDOW_HEIGHT / h.max(1)).clamp(1, 32);
+
     let context = BTermBuilder::new()
         .with_title("pas cman")
         .with_dimensions(w, h)
         //.with_fps_cap(30.0)
-        .with_tile_dimensions(32, 32)
+        .with_tile_dimensions(tile, tile)
         .with_resource_path(resources)
         .with_font("pas-cman-font-32.png", 32, 32)
         .with_font("terminal8x8.png", 8, 8)
@@ -5,11 +5,18 @@
 //! Date:    March 2023
 //! Licence: MIT 
 
-/// Une map est constituée de 30 x 20 tuiles. Chacunes de ces tuiles peut etre
+/// Par défaut, une map a une dimension de 30 colonnes et 20 lignes. Le serveur
+/// annonce celles de la map qu'il utilise avec le message BOARD.
+pub const WIDTH: usize = 30;
+
+/// cf. WIDTH
+pub const HEIGHT: usize = 20;
+
+/// Une map est constituée de 30 x 20 tuiles (par défaut). Chacunes de ces tuiles peut etre
 /// soit un mur, soit du sol. Il n'est possible de placer de la nourriture que
 /// sur les cases de qui sont du sol. Il n'est aussi possible de se déplacer 
 /// que sur des cases qui sont du sol.
-pub const MAP_SIZE: usize = 30*20; 
+pub const MAP_SIZE: usize = WIDTH*HEIGHT; 
 
 /// Lorsqu'un utilisateur utilisera les flèches de son clavier au sein de
 /// l'interface graphique, celle-ci écrira une direction (haut, bas, gauche, droite)
@@ -38,15 +45,39 @@ pub struct Position {
 /// Un item est tout type d'élément qui peut exister sur le plateau de jeu.
 /// Au début du jeu, tous les items sont introduits à l'aide de messages 
 /// de type 'spawn'.
-#[repr(C)]
-#[derive(Debug, Clone, Copy)]
-pub enum Item {
-    WALL      = 1, // un mur - type de tuile qui constitue un obstacle sur la carte  
-    FLOOR     = 2, // du sol - type de tuile sur lesquelles on peut marcher sur la carte
-    FOOD      = 3, // de la nourriture - les resources que les joueures doivent collecter pour gagner
-    SUPERFOOD = 4, // de la superfood qui rapporte plus de points que la nourriture normale
-    PLAYER1   = 5, // le joueur 1
-    PLAYER2   = 6, // le joueur 1
+///
+/// Le joueur numéro i + 1 (i = 0, ..., MAX_PLAYERS - 1) est l'item
+/// `Item::PLAYER1.0 + i` (cf. `Item::player` et PLAYER_ITEM dans pascman.h).
+#[repr(transparent)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Item(pub u32);
+
+#[allow(dead_code)]
+impl Item {
+    pub const WALL      : Item = Item(1); // un mur - type de tuile qui constitue un obstacle sur la carte
+    pub const FLOOR     : Item = Item(2); // du sol - type de tuile sur lesquelles on peut marcher sur la carte
+    pub const FOOD      : Item = Item(3); // de la nourriture - les resources que les joueures doivent collecter pour gagner
+    pub const SUPERFOOD : Item = Item(4); // de la superfood qui rapporte plus de points que la nourriture normale
+    pub const PLAYER1   : Item = Item(5); // le joueur 1
+    pub const PLAYER2   : Item = Item(6); // le joueur 2
+    // ... les joueurs suivants, jusqu'à PLAYER1 + MAX_PLAYERS - 1
+
+    /// Le nombre maximum de joueurs d'une partie (cf. MAX_PLAYERS dans pascman.h)
+    pub const MAX_PLAYERS: u32 = 64;
+
+    /// Le joueur d'indice `index` (0 pour le joueur 1)
+    pub fn player(index: u32) -> Item {
+        Item(Item::PLAYER1.0 + index)
+    }
+
+    /// L'indice du joueur (0 pour le joueur 1), ou None si l'item n'est pas un joueur
+    pub fn player_index(self) -> Option<u32> {
+        if self.0 >= Item::PLAYER1.0 && self.0 < Item::PLAYER1.0 + Item::MAX_PLAYERS {
+            Some(self.0 - Item::PLAYER1.0)
+        } else {
+            None
+        }
+    }
 }
 
 /// Le type de message qui est envoyé depuis l'extérieur à notre interface de jeu
@@ -64,6 +95,34 @@ pub enum MessageType {
     EAT_FOOD = 3,
     /// To indicate that game is over
     GAME_OVER = 4,
+    /// To draw a whole row (or part of a row) of the map at once
+    MAP_CHUNK = 5,
+    /// To replace the whole state of the game (for a client joining late)
+    SNAPSHOT = 6,
+    /// To announce the dimensions of the map
+    BOARD = 7,
+    /// To give the score of a player (in a snapshot)
+    SCORE = 8,
+}
+
+/// La façon dont les messages sont encodés sur le fil (cf. `enum Protocol` dans
+/// pascman.h pour le détail des formats).
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Protocol {
+    /// Chaque message est la copie brute de l'union `Message`
+    Legacy    = 0,
+    /// Un octet de type suivi des champs encodés en varint
+    CompactV1 = 1,
+}
+
+impl Protocol {
+    pub fn from_u32(value: u32) -> Option<Self> {
+        match value {
+            0 => Some(Protocol::Legacy),
+            1 => Some(Protocol::CompactV1),
+            _ => None,
+        }
+    }
 }
 
 /// Registration est le message qui sert à dire au jeu qu'on est un joueur en particulier.
@@ -73,6 +132,8 @@ pub struct Registration {
     /// Ce messagetype devra toujours avoir la valeur REGISTRATION
     pub msgt: MessageType,
     pub player: u32,
+    /// Le protocole utilisé pour tous les messages qui suivent celui-ci
+    pub protocol: u32,
 }
 
 /// Spawn est le message qui sert à introduire un item dans le jeu.
@@ -127,6 +188,92 @@ pub struct GameOver {
     pub winner: u32,
 }
 
+/// Nombre maximum de cases décrites par un seul message MAP_CHUNK.
+pub const MAP_CHUNK_CELLS: usize = 32;
+
+/// Le contenu d'une case de la map tel qu'il est encodé dans un MAP_CHUNK
+/// (2 bits par case).
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ChunkCell {
+    Wall      = 0,
+    Floor     = 1,
+    Food      = 2,
+    Superfood = 3,
+}
+
+/// MapChunk sert à dessiner d'un coup 'len' cases consécutives d'une ligne de
+/// la map (de {x, y} à {x + len - 1, y}). La nourriture introduite par un 
+/// MAP_CHUNK a pour identifiant l'index de sa case: y * largeur + x.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct MapChunk {
+    /// Ce messagetype devra toujours avoir la valeur MAP_CHUNK
+    pub msgt: MessageType,
+    pub y: u16,
+    pub x: u16,
+    pub len: u16,
+    pub reserved: u16,
+    /// Le contenu des cases, 2 bits par case
+    pub cells: [u8; MAP_CHUNK_CELLS / 4],
+}
+
+impl MapChunk {
+    /// Le contenu de la i-eme case décrite par ce chunk
+    pub fn cell(&self, i: usize) -> ChunkCell {
+        match (self.cells[i / 4] >> (2 * (i % 4))) & 3 {
+            0 => ChunkCell::Wall,
+            1 => ChunkCell::Floor,
+            2 => ChunkCell::Food,
+            _ => ChunkCell::Superfood,
+        }
+    }
+}
+
+/// Snapshot annonce l'état complet d'une partie en cours à un client qui la
+/// rejoint. Il est suivi de 'nb_players' messages SCORE (un par joueur), de
+/// 'chunks' messages MAP_CHUNK (toute la map), d'un SPAWN par joueur et, si la partie est terminée, du message GAME_OVER.
+///
+/// A la réception de ce message, le client oublie tout ce qu'il savait de la
+/// partie (map, nourriture et joueurs) avant d'appliquer ce qui suit.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct Snapshot {
+    /// Ce messagetype devra toujours avoir la valeur SNAPSHOT
+    pub msgt: MessageType,
+    /// Le nombre de messages MAP_CHUNK qui suivent
+    pub chunks: u16,
+    pub reserved: u16,
+    /// Le nombre de joueurs de la partie (et donc de messages SCORE qui suivent)
+    pub nb_players: u32,
+    /// Le nombre d'éléments qui peuvent encore etre mangés sur la map
+    pub food_count: u32,
+}
+
+/// Board annonce les dimensions de la map. Il précède toujours les MAP_CHUNK
+/// qui la décrivent: le client y dimensionne sa propre map.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct Board {
+    /// Ce messagetype devra toujours avoir la valeur BOARD
+    pub msgt: MessageType,
+    /// Le nombre de colonnes de la map
+    pub width: u16,
+    /// Le nombre de lignes de la map
+    pub height: u16,
+}
+
+/// Score donne le score d'un joueur. Il n'est envoyé qu'à la suite d'un
+/// SNAPSHOT: ensuite, le client tient les scores à jour grace aux EAT_FOOD.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct Score {
+    /// Ce messagetype devra toujours avoir la valeur SCORE
+    pub msgt: MessageType,
+    /// Le numéro du joueur (de 1 à nb_players)
+    pub player: u32,
+    pub score: u32,
+}
+
 #[repr(C)]
 #[derive(Clone, Copy)]
 pub union Message {
@@ -136,4 +283,233 @@ pub union Message {
     pub movement: Movement,
     pub eat_food: EatFood,
     pub game_over: GameOver,
-}
\ No newline at end of file
+    pub map_chunk: MapChunk,
+    pub snapshot: Snapshot,
+    pub board: Board,
+    pub score: Score,
+}
+
+/// Erreur rencontrée lors du décodage d'un flux de messages
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum DecodeError {
+    /// Le type de message n'existe pas
+    UnknownMessageType(u32),
+    /// Le type d'item n'existe pas
+    UnknownItem(u32),
+    /// Le protocole annoncé lors de l'enregistrement n'existe pas
+    UnknownProtocol(u32),
+    /// Un entier encodé en varint ne tient pas sur 32 bits
+    InvalidVarint,
+    /// Un MAP_CHUNK décrit plus de MAP_CHUNK_CELLS cases
+    InvalidChunk(usize),
+}
+
+impl MessageType {
+    pub fn from_u32(value: u32) -> Result<Self, DecodeError> {
+        match value {
+            0 => Ok(MessageType::REGISTRATION),
+            1 => Ok(MessageType::SPAWN),
+            2 => Ok(MessageType::MOVEMENT),
+            3 => Ok(MessageType::EAT_FOOD),
+            4 => Ok(MessageType::GAME_OVER),
+            5 => Ok(MessageType::MAP_CHUNK),
+            6 => Ok(MessageType::SNAPSHOT),
+            7 => Ok(MessageType::BOARD),
+            8 => Ok(MessageType::SCORE),
+            _ => Err(DecodeError::UnknownMessageType(value)),
+        }
+    }
+}
+
+impl Item {
+    pub fn from_u32(value: u32) -> Result<Self, DecodeError> {
+        match Item(value) {
+            Item::WALL | Item::FLOOR | Item::FOOD | Item::SUPERFOOD => Ok(Item(value)),
+            item if item.player_index().is_some()                   => Ok(item),
+            _ => Err(DecodeError::UnknownItem(value)),
+        }
+    }
+}
+
+/// Le décodeur transforme le flux d'octets envoyé par le serveur en messages.
+///
+/// Au départ, il attend des messages encodés avec `Protocol::Legacy`. Dès qu'il
+/// décode un message REGISTRATION, il utilise le protocole qui y est annoncé
+/// pour tous les messages suivants.
+pub struct Decoder {
+    protocol: Protocol,
+    pending : Vec<u8>,
+    start   : usize,
+}
+
+impl Default for Decoder {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Decoder {
+    pub fn new() -> Self {
+        Self { protocol: Protocol::Legacy, pending: vec![], start: 0 }
+    }
+
+    /// Le protocole actuellement utilisé pour décoder les messages
+    pub fn protocol(&self) -> Protocol {
+        self.protocol
+    }
+
+    /// Ajoute des octets reçus à la suite de ceux qui n'ont pas encore été décodés
+    pub fn feed(&mut self, bytes: &[u8]) {
+        if self.start > 0 {
+            self.pending.drain(..self.start);
+            self.start = 0;
+        }
+        self.pending.extend_from_slice(bytes);
+    }
+
+    /// Décode le prochain message complet, s'il y en a un
+    pub fn next_message(&mut self) -> Result<Option<Message>, DecodeError> {
+        let input = &self.pending[self.start..];
+        let decoded = match self.protocol {
+            Protocol::Legacy    => decode_legacy(input)?,
+            Protocol::CompactV1 => decode_compact(input)?,
+        };
+
+        match decoded {
+            None => Ok(None),
+            Some((msg, len)) => {
+                self.start += len;
+                unsafe {
+                    if let MessageType::REGISTRATION = msg.msgt {
+                        let protocol = msg.registration.protocol;
+                        self.protocol = Protocol::from_u32(protocol)
+                            .ok_or(DecodeError::UnknownProtocol(protocol))?;
+                    }
+                }
+                Ok(Some(msg))
+            }
+        }
+    }
+}
+
+/// Décode un message encodé avec `Protocol::Legacy` (copie brute de l'union)
+fn decode_legacy(input: &[u8]) -> Result<Option<(Message, usize)>, DecodeError> {
+    const SIZE: usize = std::mem::size_of::<Message>();
+    if input.len() < SIZE {
+        return Ok(None);
+    }
+
+    // on vérifie les valeurs des enums avant de réinterpréter les octets
+    let word = |i: usize| u32::from_ne_bytes(input[4*i..4*i+4].try_into().unwrap());
+    if let MessageType::SPAWN = MessageType::from_u32(word(0))? {
+        Item::from_u32(word(2))?;
+    }
+
+    let msg = unsafe { std::ptr::read_unaligned(input.as_ptr() as *const Message) };
+    Ok(Some((msg, SIZE)))
+}
+
+/// Décode un message encodé avec `Protocol::CompactV1`
+fn decode_compact(input: &[u8]) -> Result<Option<(Message, usize)>, DecodeError> {
+    let mut reader = FieldReader { input, pos: 0 };
+    macro_rules! field {
+        ($read:expr) => {
+            match $read? {
+                Some(value) => value,
+                None        => return Ok(None),
+            }
+        };
+    }
+
+    let msgt = field!(reader.byte());
+    let msg  = match MessageType::from_u32(msgt)? {
+        MessageType::REGISTRATION => Message { registration: Registration {
+            msgt    : MessageType::REGISTRATION,
+            player  : field!(reader.varint()),
+            protocol: field!(reader.varint()),
+        }},
+        MessageType::SPAWN => Message { spawn: Spawn {
+            msgt: MessageType::SPAWN,
+            id  : field!(reader.varint()),
+            item: Item::from_u32(field!(reader.byte()))?,
+            pos : Position { x: field!(reader.varint()), y: field!(reader.varint()) },
+        }},
+        MessageType::MOVEMENT => Message { movement: Movement {
+            msgt: MessageType::MOVEMENT,
+            id  : field!(reader.varint()),
+            pos : Position { x: field!(reader.varint()), y: field!(reader.varint()) },
+        }},
+        MessageType::EAT_FOOD => Message { eat_food: EatFood {
+            msgt : MessageType::EAT_FOOD,
+            eater: field!(reader.varint()),
+            food : field!(reader.varint()),
+        }},
+        MessageType::GAME_OVER => Message { game_over: GameOver {
+            msgt  : MessageType::GAME_OVER,
+            winner: field!(reader.varint()),
+        }},
+        MessageType::MAP_CHUNK => {
+            let y   = field!(reader.varint()) as u16;
+            let x   = field!(reader.varint()) as u16;
+            let len = field!(reader.varint()) as usize;
+            if len > MAP_CHUNK_CELLS {
+                return Err(DecodeError::InvalidChunk(len));
+            }
+            let mut cells = [0_u8; MAP_CHUNK_CELLS / 4];
+            for cell in cells.iter_mut().take((len + 3) / 4) {
+                *cell = field!(reader.byte()) as u8;
+            }
+            Message { map_chunk: MapChunk {
+                msgt: MessageType::MAP_CHUNK, y, x, len: len as u16, reserved: 0, cells,
+            }}
+        },
+        MessageType::SNAPSHOT => Message { snapshot: Snapshot {
+            msgt      : MessageType::SNAPSHOT,
+            chunks    : field!(reader.varint()) as u16,
+            reserved  : 0,
+            nb_players: field!(reader.varint()),
+            food_count: field!(reader.varint()),
+        }},
+        MessageType::BOARD => Message { board: Board {
+            msgt  : MessageType::BOARD,
+            width : field!(reader.varint()) as u16,
+            height: field!(reader.varint()) as u16,
+        }},
+        MessageType::SCORE => Message { score: Score {
+            msgt  : MessageType::SCORE,
+            player: field!(reader.varint()),
+            score : field!(reader.varint()),
+        }},
+    };
+    Ok(Some((msg, reader.pos)))
+}
+
+/// Lit un à un les champs d'un message compact
+struct FieldReader<'a> {
+    input: &'a [u8],
+    pos  : usize,
+}
+
+impl FieldReader<'_> {
+    fn byte(&mut self) -> Result<Option<u32>, DecodeError> {
+        match self.input.get(self.pos) {
+            None => Ok(None),
+            Some(b) => {
+                self.pos += 1;
+                Ok(Some(*b as u32))
+            }
+        }
+    }
+
+    fn varint(&mut self) -> Result<Option<u32>, DecodeError> {
+        let mut value = 0_u32;
+        for shift in (0..35).step_by(7) {
+            let Some(byte) = self.byte()? else { return Ok(None) };
+            value |= (byte & 0x7F) << shift;
+            if byte & 0x80 == 0 {
+                return Ok(Some(value));
+            }
+        }
+        Err(DecodeError::InvalidVarint)
+    }
+}
@@ -9,6 +9,8 @@ use std::ops::Index;
 
 use bracket_lib::{pathfinding::{Algorithm2D, BaseMap, SmallVec}, terminal::{DistanceAlg, Point}};
 
+use legion::Entity;
+
 use crate::Position;
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -17,11 +19,44 @@ pub enum TileType {
     Floor,
 }
 
+/// A rectangle of tiles (from `x0, y0` included to `x1, y1` excluded)
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct DirtyRect {
+    pub x0: usize,
+    pub y0: usize,
+    pub x1: usize,
+    pub y1: usize,
+}
+
+impl DirtyRect {
+    /// The rectangle made of the single tile (x, y)
+    fn tile(x: usize, y: usize) -> Self {
+        Self { x0: x, y0: y, x1: x + 1, y1: y + 1 }
+    }
+
+    /// The smallest rectangle covering both self and other
+    fn union(self, other: Self) -> Self {
+        Self {
+            x0: self.x0.min(other.x0),
+            y0: self.y0.min(other.y0),
+            x1: self.x1.max(other.x1),
+            y1: self.y1.max(other.y1),
+        }
+    }
+}
+
+/// The map of the game.
+///
+/// The map only changes when the server describes it (SPAWN burst, MAP_CHUNK,
+/// SNAPSHOT): the tiles must therefore be modified through `set_tile`, `fill`
+/// and `resize`, which keep track of the part of the map that needs to be
+/// drawn again (see `take_dirty` and the render_map system).
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub struct Map{
     pub width: usize,
     pub height: usize,
-    pub tiles: Vec<TileType>
+    pub tiles: Vec<TileType>,
+    dirty: Option<DirtyRect>,
 }
 
 impl Index<Position> for Map {
@@ -41,12 +76,96 @@ impl Index<Point> for Map {
 }
 
 impl Map {
+    /// Creates a map of the given dimensions, made of floor tiles only
+    pub fn new(width: usize, height: usize) -> Self {
+        let mut map = Self { width, height, tiles: vec![TileType::Floor; width * height], dirty: None };
+        map.mark_all_dirty();
+        map
+    }
+
+    /// Gives the map the dimensions announced by the server (BOARD message).
+    /// The tiles are all reset to walls: the MAP_CHUNKs which follow draw the map.
+    pub fn resize(&mut self, width: usize, height: usize) {
+        self.width  = width;
+        self.height = height;
+        self.tiles.clear();
+        self.tiles.resize(width * height, TileType::Wall);
+        self.mark_all_dirty();
+    }
+
+    /// Sets the tile at index idx (the tile only needs to be drawn again if it changed)
+    pub fn set_tile(&mut self, idx: usize, tile: TileType) {
+        if self.tiles[idx] != tile {
+            self.tiles[idx] = tile;
+            let rect  = DirtyRect::tile(idx % self.width, idx / self.width);
+            self.dirty = Some(self.dirty.map_or(rect, |dirty| dirty.union(rect)));
+        }
+    }
+
+    /// Sets all the tiles of the map
+    pub fn fill(&mut self, tile: TileType) {
+        self.tiles.fill(tile);
+        self.mark_all_dirty();
+    }
+
+    /// Returns the part of the map which changed since the last call (if any)
+    /// and forgets about it: the caller is expected to draw it again.
+    pub fn take_dirty(&mut self) -> Option<DirtyRect> {
+        self.dirty.take()
+    }
+
+    /// The whole map needs to be drawn again
+    fn mark_all_dirty(&mut self) {
+        self.dirty = Some(DirtyRect { x0: 0, y0: 0, x1: self.width, y1: self.height });
+    }
+
+    /// Returns true iff the position lies on the map
+    pub fn contains(&self, Position{x, y}: Position) -> bool {
+        x < self.width && y < self.height
+    }
+
     /// Returns true iff the entity is allowed to move on to the next position (x,y)
     pub fn can_enter(&self, dest: Point) -> bool {
         self.in_bounds(dest) && self[dest] == TileType::Floor
     }
 }
 
+/// The entities of the game indexed by their id, so that a MOVEMENT or an
+/// EAT_FOOD is applied without searching the whole world for its entity.
+///
+/// The ids given by the server are dense (see game.h: the food of the tile
+/// at index i has the id i, player k has the id 3*N + k on a map of N tiles),
+/// which is why a plain vector is enough.
+#[derive(Debug, Default)]
+pub struct Entities(Vec<Option<Entity>>);
+
+impl Entities {
+    /// Returns the entity having the given id (if any)
+    pub fn get(&self, id: u32) -> Option<Entity> {
+        self.0.get(id as usize).copied().flatten()
+    }
+
+    /// Remembers that entity has the given id. Returns the entity which
+    /// previously had that id (if any)
+    pub fn insert(&mut self, id: u32, entity: Entity) -> Option<Entity> {
+        let id = id as usize;
+        if id >= self.0.len() {
+            self.0.resize(id + 1, None);
+        }
+        self.0[id].replace(entity)
+    }
+
+    /// Forgets about the entity having the given id and returns it (if any)
+    pub fn remove(&mut self, id: u32) -> Option<Entity> {
+        self.0.get_mut(id as usize).and_then(Option::take)
+    }
+
+    /// Forgets about all entities (see World::clear)
+    pub fn clear(&mut self) {
+        self.0.clear();
+    }
+}
+
 impl Algorithm2D for Map {
     fn dimensions(&self) -> Point {
         Point::new(self.width, self.height)
@@ -1,4 +1,4 @@
-use legion::World;
+use legion::{Entity, World};
 
 use crate::*;
 
@@ -7,36 +7,30 @@ static PLAYER_MARKS : [[char; 4]; 2] = [
     ['!', '1', 'A', '!'], // 'villain 1'
 ];
 
-pub fn spawn_player1 (ecs : &mut World, id: u32, pos : Position) {
+/// Spawns the player having the given index (0 for player 1): player 1 looks
+/// like the hero, all the others look like the 'villain'
+pub fn spawn_player (ecs : &mut World, id: u32, index: u32, pos : Position) -> Entity {
+    let marks = if index == 0 { &PLAYER_MARKS[0] } else { &PLAYER_MARKS[1] };
     ecs.push((
         Id(id),
-        Character(&PLAYER_MARKS[0]),
+        Character(marks),
         Hero,
         pos,
         Direction::Down,
-    ));
+    ))
 }
-pub fn spawn_player2 (ecs : &mut World, id: u32, pos : Position) {
-    ecs.push((
-        Id(id),
-        Character(&PLAYER_MARKS[1]),
-        Hero,
-        pos,
-        Direction::Down,
-    ));
-}
-pub fn spawn_seed(ecs : &mut World, id: u32, pos : Position) {
+pub fn spawn_seed(ecs : &mut World, id: u32, pos : Position) -> Entity {
     ecs.push((
         Id(id),
         Food('.'),
         pos,
-    ));
+    ))
 }
-pub fn spawn_superfood(ecs : &mut World, id: u32, pos : Position) {
+pub fn spawn_superfood(ecs : &mut World, id: u32, pos : Position) -> Entity {
     ecs.push((
         Id(id),
         Food('*'),
         Superfood,
         pos,
-    ));
+    ))
 }
\ No newline at end of file
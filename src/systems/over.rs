@@ -10,11 +10,12 @@ use std::process::exit;
 
 use bracket_lib::prelude::*;
 use legion::{Schedule, system};
-use crate::{proceed_to_restart_system, GameStatus, Map, Player};
+use crate::{proceed_to_restart_system, render_scores_system, GameStatus, Map, Player};
 
 pub fn game_over_schedule() -> Schedule {
     Schedule::builder()
         .add_system(render_gameover_screen_system())
+        .add_system(render_scores_system())
         .add_system(proceed_to_restart_system())
         .build()
 }
@@ -7,7 +7,7 @@
 
 use std::io::{self, Write};
 
-use bracket_lib::{color::{ColorPair, BLACK, WHITE}, terminal::{to_cp437, DrawBatch, Point}};
+use bracket_lib::{color::{ColorPair, BLACK, WHITE, YELLOW}, terminal::{to_cp437, DrawBatch, Point}};
 use crate::*;
 
 /// This function creates the ECS schedule which decides when a given system should be run
@@ -20,6 +20,7 @@ pub fn run_game_schedule() -> Schedule {
         .flush()
         .add_system(render_food_system())
         .add_system(render_characters_system())
+        .add_system(render_scores_system())
         .flush()
         .add_system(remove_gone_system())
         .build()
@@ -47,14 +48,18 @@ pub fn user_input(
     }
 }
 
-/// This system renders the world map
+/// This system renders the world map. The map console is never cleared (see
+/// State::tick): only the tiles which changed since the previous frame are drawn.
 #[system]
-pub fn render_map(#[resource] map: &Map) {
+pub fn render_map(#[resource] map: &mut Map) {
+    let Some(dirty) = map.take_dirty() else {
+        return;
+    };
     let mut drawbatch = DrawBatch::new();
     drawbatch.target(0);
 
-    for y in 0..map.height {
-        for x in 0..map.width {
+    for y in dirty.y0..dirty.y1 {
+        for x in dirty.x0..dirty.x1 {
             let pos   = Position{x, y};
             let glyph = match map[pos] {
                 TileType::Wall  => to_cp437('0'),
@@ -74,13 +79,13 @@ pub fn render_map(#[resource] map: &Map) {
 #[system]
 #[read_component(Food)]
 #[read_component(Position)]
-pub fn render_food(ecs: &SubWorld) {
+pub fn render_food(ecs: &SubWorld, #[resource] map: &Map) {
     let mut batch = DrawBatch::new();
     batch.target(1);
 
     <(&Position, &Food)>::query()
         .iter(ecs)
-        .filter(|(pos, _food)| pos.is_valid())
+        .filter(|(pos, _food)| map.contains(**pos))
         .for_each(|(pos, food)| {
             batch.set(
                 pos.into_point(),
@@ -96,13 +101,13 @@ pub fn render_food(ecs: &SubWorld) {
 #[read_component(Character)]
 #[read_component(Position)]
 #[read_component(Direction)]
-pub fn render_characters(ecs: &SubWorld) {
+pub fn render_characters(ecs: &SubWorld, #[resource] map: &Map) {
     let mut batch = DrawBatch::new();
     batch.target(2);
 
     <(&Position, &Character, &Direction)>::query()
         .iter(ecs)
-        .filter(|(pos, _character, _direction)| pos.is_valid())
+        .filter(|(pos, _character, _direction)| map.contains(**pos))
         .for_each(|(pos, character, direction)| {
             batch.set(
                 pos.into_point(),
@@ -114,6 +119,30 @@ pub fn render_characters(ecs: &SubWorld) {
     batch.submit(10_000).expect("draw entity error");
 }
 
+/// This system writes the score of each player on the top of the message
+/// console (the score of the player using this client in yellow)
+#[system]
+pub fn render_scores(#[resource] scores: &Scores, #[resource] player: &Player, #[resource] map: &Map) {
+    let mut batch = DrawBatch::new();
+    batch.target(3);
+
+    // the message console has twice as many columns as the map
+    let width = map.width * 2;
+    let (mut x, mut y) = (0, 0);
+    for (i, score) in scores.0.iter().enumerate() {
+        let text = format!(" P{}: {} ", i + 1, score);
+        if x > 0 && x + text.len() > width {
+            x  = 0;
+            y += 1;
+        }
+        let color = if i as u32 + 1 == player.0 { YELLOW } else { WHITE };
+        batch.print_color(Point::new(x, y), &text, ColorPair::new(color, BLACK));
+        x += text.len();
+    }
+
+    batch.submit(15_000).expect("draw scores error");
+}
+
 #[system]
 #[write_component(Position)]
 #[write_component(Direction)]
@@ -0,0 +1,112 @@
+#include <errno.h>
+
+#include "utils_v3.h"
+
+#include "tick.h"
+
+#define NS_PER_SEC 1000000000ull
+
+// Ajoute 'ns' nanosecondes à 'ts'.
+static void __add_ns(struct timespec *ts, uint64_t ns) {
+    uint64_t total = (uint64_t) ts->tv_nsec + ns;
+    ts->tv_sec  += (time_t) (total / NS_PER_SEC);
+    ts->tv_nsec  = (long) (total % NS_PER_SEC);
+}
+
+// Renvoie 'a' - 'b' en nanosecondes.
+static int64_t __diff_ns(const struct timespec *a, const struct timespec *b) {
+    return (int64_t) (a->tv_sec - b->tv_sec) * (int64_t) NS_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+// Cette fonction prépare la simulation de la partie 'state' à raison de 'hz' ticks par seconde.
+void tick_init(struct TickLoop *loop, struct GameState *state, struct Sink *sink, unsigned hz) {
+    checkCond(hz == 0, "Error: the tick rate must be positive");
+    loop->state     = state;
+    loop->sink      = sink;
+    loop->period_ns = NS_PER_SEC / hz;
+    loop->tick      = 0;
+    for (size_t i = 0; i < MAX_PLAYERS; i++) {
+        loop->has_latest[i] = false;
+    }
+    checkNeg(clock_gettime(CLOCK_MONOTONIC, &loop->deadline), "Error CLOCK_GETTIME");
+    __add_ns(&loop->deadline, loop->period_ns);
+}
+
+// Cette fonction enregistre une commande du joueur 'player' pour le tick en cours.
+void tick_submit(struct TickLoop *loop, enum Item player, enum Direction dir) {
+    // la file est remplie par d'autres processus: un joueur inconnu est ignoré
+    if (!IS_PLAYER(player) || PLAYER_INDEX(player) >= loop->state->nb_players) {
+        return;
+    }
+    size_t offset = PLAYER_INDEX(player);
+    loop->latest[offset]     = dir;
+    loop->has_latest[offset] = true;
+}
+
+// Cette fonction retire toutes les commandes de la file et les enregistre pour le tick en cours.
+size_t tick_collect(struct TickLoop *loop, struct CommandQueue *queue) {
+    struct Command batch[CMDQ_MAX_BATCH];
+    size_t total = 0;
+    size_t count;
+    while ((count = cmdq_pop_batch(queue, batch, CMDQ_MAX_BATCH)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            tick_submit(loop, batch[i].player, batch[i].dir);
+        }
+        total += count;
+    }
+    return total;
+}
+
+// Cette fonction termine le tick en cours: les commandes retenues sont appliquées.
+bool tick_step(struct TickLoop *loop) {
+    struct Command cmds[MAX_PLAYERS];
+    size_t count = 0;
+    // l'échéance du tick qui se termine (en ns, comme cmdq_now)
+    uint64_t now = (uint64_t) loop->deadline.tv_sec * NS_PER_SEC + (uint64_t) loop->deadline.tv_nsec
+                   - loop->period_ns;
+    // toujours le meme ordre: PLAYER1, PLAYER2, ...
+    for (size_t i = 0; i < loop->state->nb_players; i++) {
+        if (loop->has_latest[i]) {
+            cmds[count].player    = PLAYER_ITEM(i);
+            cmds[count].dir       = loop->latest[i];
+            cmds[count].timestamp = now;
+            count++;
+            loop->has_latest[i] = false;
+        }
+    }
+    loop->tick++;
+    if (count == 0) {
+        // rien à faire (et donc rien à envoyer) pendant ce tick
+        return loop->state->game_over;
+    }
+    return cmdq_apply(loop->state, cmds, count, loop->sink);
+}
+
+// Cette fonction attend l'échéance du tick en cours.
+void tick_wait(struct TickLoop *loop) {
+    int res;
+    while ((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &loop->deadline, NULL)) == EINTR) {
+        // interrompu par un signal: on se rendort jusqu'à la meme échéance
+    }
+    checkCond(res != 0, "Error CLOCK_NANOSLEEP");
+
+    struct timespec now;
+    checkNeg(clock_gettime(CLOCK_MONOTONIC, &now), "Error CLOCK_GETTIME");
+    __add_ns(&loop->deadline, loop->period_ns);
+    if (__diff_ns(&now, &loop->deadline) >= 0) {
+        // plus d'un tick de retard: on repart de maintenant plutot que
+        // d'enchainer les ticks manqués
+        loop->deadline = now;
+        __add_ns(&loop->deadline, loop->period_ns);
+    }
+}
+
+// Cette fonction fait tourner la partie jusqu'à ce qu'elle soit terminée.
+void tick_run(struct TickLoop *loop, struct CommandQueue *queue) {
+    bool over = loop->state->game_over;
+    while (!over) {
+        tick_wait(loop);
+        tick_collect(loop, queue);
+        over = tick_step(loop);
+    }
+}
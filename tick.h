@@ -0,0 +1,76 @@
+#ifndef __TICK__
+#define __TICK__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "pascman.h"
+#include "game.h"
+#include "cmdqueue.h"
+#include "sink.h"
+
+// Ce module fait tourner une partie à une fréquence fixe (par exemple 30 Hz),
+// plutot que de traiter chaque commande dès qu'elle arrive:
+//
+// - Pendant un tick, on ne retient que la dernière direction demandée par
+//   chaque joueur (les commandes précédentes sont écrasées).
+// - A la fin du tick, les directions retenues sont appliquées d'un coup,
+//   toujours dans le meme ordre (PLAYER1, PLAYER2, ...), ce qui rend la
+//   simulation déterministe.
+// - Les messages générés par un tick partent d'un coup (en un seul write pour
+//   un sink SINK_FD).
+//
+// Le cout d'une partie est ainsi borné (au plus une commande par joueur et par tick),
+// quelle que soit la vitesse à laquelle les clients envoient leurs commandes.
+
+struct TickLoop
+{
+    // La partie simulée et le sink dans lequel ses messages sont envoyés.
+    struct GameState *state;
+    struct Sink *sink;
+    // La durée d'un tick (en ns).
+    uint64_t period_ns;
+    // L'échéance du prochain tick (CLOCK_MONOTONIC).
+    struct timespec deadline;
+    // Le numéro du tick en cours.
+    uint64_t tick;
+    // La dernière direction demandée par chaque joueur pendant le tick en cours.
+    enum Direction latest[MAX_PLAYERS];
+    bool has_latest[MAX_PLAYERS];
+};
+
+// Cette fonction prépare la simulation de la partie 'state' à raison de 'hz'
+// ticks par seconde. Les messages générés seront envoyés dans 'sink' (qui doit
+// rester valide tant que la simulation tourne).
+void tick_init(struct TickLoop *loop, struct GameState *state, struct Sink *sink, unsigned hz);
+
+// Cette fonction enregistre une commande du joueur 'player' pour le tick en
+// cours (elle remplace la commande précédente du meme joueur). Une commande
+// d'un joueur qui n'est pas dans la partie est ignorée.
+void tick_submit(struct TickLoop *loop, enum Item player, enum Direction dir);
+
+// Cette fonction retire toutes les commandes de la file 'queue' et les
+// enregistre pour le tick en cours (cf. tick_submit). Elle renvoie le nombre
+// de commandes retirées.
+size_t tick_collect(struct TickLoop *loop, struct CommandQueue *queue);
+
+// Cette fonction termine le tick en cours: les commandes retenues sont
+// appliquées et leurs messages envoyés d'un coup (cf. cmdq_apply). Le
+// timestamp de ces commandes est l'échéance du tick (en ns, cf. cmdq_now).
+//
+// Par ailleurs, cette fonction renvoie 'true' si la partie est terminée, false sinon.
+bool tick_step(struct TickLoop *loop);
+
+// Cette fonction attend l'échéance du tick en cours (sans dériver: les
+// échéances sont absolues). Si on a pris plus d'un tick de retard, les ticks
+// manqués sont abandonnés.
+void tick_wait(struct TickLoop *loop);
+
+// Cette fonction fait tourner la partie jusqu'à ce qu'elle soit terminée: à
+// chaque tick, elle attend l'échéance, retire les commandes de 'queue' et
+// les applique.
+void tick_run(struct TickLoop *loop, struct CommandQueue *queue);
+
+#endif //__TICK__
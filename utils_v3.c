@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <errno.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/types.h>
@@ -13,6 +14,11 @@
 #include <sys/sem.h>
 #include <sys/shm.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 #include "utils_v3.h"
 
@@ -209,19 +215,27 @@ ssize_t swrite(int fd, const void *buf, size_t count) {
   return r;
 }
 
-void nwrite(int fd, const void* buf, size_t count) {
+// Same as nwrite, but returns the number of "write" system calls performed
+static size_t nwrite_count(int fd, const void* buf, size_t count) {
   char* cbuf = (char*) buf;
   int s = swrite(fd, cbuf, count);
   int i = s;
+  size_t calls = 1;
   while(s != 0 && i != count) {
     s =  swrite(fd, cbuf + i, count - i);
     i += s;
+    calls++;
   }
 
   if (i != count) {
     fprintf(stderr, "Unable to write %lu byte(s)\n", count);
     exit(EXIT_FAILURE);
-  } 
+  }
+  return calls;
+}
+
+void nwrite(int fd, const void* buf, size_t count) {
+  nwrite_count(fd, buf, count);
 }
 
 char **readFileToTable(int fd) {
@@ -267,6 +281,94 @@ char **readFileToTable(int fd) {
     return lines;
 }
 
+char *readFileToBuffer(int fd, size_t *len) {
+  struct stat st;
+  int r = fstat(fd, &st);
+  checkNeg(r, "Error FSTAT");
+
+  // for a regular file, the size is known upfront: we stop as soon as it has
+  // been read. Otherwise (pipe, socket, ...) we read until EOF, growing as needed.
+  bool   sized    = S_ISREG(st.st_mode) && st.st_size > 0;
+  size_t capacity = sized ? (size_t) st.st_size + 1 : 4096;
+  char  *buffer   = smalloc(capacity);
+  size_t length   = 0;
+
+  ssize_t nbread;
+  while (!(sized && length + 1 == capacity)
+      && (nbread = sread(fd, buffer + length, capacity - length - 1)) > 0) {
+    length += nbread;
+    if (!sized && length + 1 == capacity) {
+      capacity *= 2;
+      buffer = realloc(buffer, capacity);
+      checkNull(buffer, "Error REALLOC");
+    }
+  }
+
+  buffer[length] = '\0';
+  *len = length;
+  return buffer;
+}
+
+//***************************************************************************//
+// BUFFERED WRITES
+//***************************************************************************//
+
+void wbuf_init(struct WriteBuffer* wb, int fd, size_t capacity) {
+  wb->fd          = fd;
+  wb->data        = smalloc(capacity);
+  wb->capacity    = capacity;
+  wb->length      = 0;
+  wb->nb_syscalls = 0;
+}
+
+void wbuf_write(struct WriteBuffer* wb, const void* buf, size_t count) {
+  if (wb->length + count > wb->capacity) {
+    wbuf_flush(wb);
+  }
+  if (count > wb->capacity) {
+    wbuf_write_direct(wb, buf, count);
+    return;
+  }
+  memcpy(wb->data + wb->length, buf, count);
+  wb->length += count;
+}
+
+void wbuf_write_direct(struct WriteBuffer* wb, const void* buf, size_t count) {
+  wbuf_flush(wb);
+  if (count > 0) {
+    wb->nb_syscalls += nwrite_count(wb->fd, buf, count);
+  }
+}
+
+size_t wbuf_flush(struct WriteBuffer* wb) {
+  if (wb->length == 0) {
+    return 0;
+  }
+  size_t calls = nwrite_count(wb->fd, wb->data, wb->length);
+  wb->nb_syscalls += calls;
+  wb->length       = 0;
+  return calls;
+}
+
+size_t wbuf_flush_to(struct WriteBuffer* wb, const int* fds, size_t nb_fds) {
+  size_t calls = 0;
+  if (wb->length > 0) {
+    for (size_t i = 0; i < nb_fds; i++) {
+      calls += nwrite_count(fds[i], wb->data, wb->length);
+    }
+  }
+  wb->nb_syscalls += calls;
+  wb->length       = 0;
+  return calls;
+}
+
+void wbuf_free(struct WriteBuffer* wb) {
+  free(wb->data);
+  wb->data     = NULL;
+  wb->capacity = 0;
+  wb->length   = 0;
+}
+
 //***************************************************************************//
 // FORK SYSCALL
 //***************************************************************************//
@@ -534,6 +636,105 @@ void sem_delete(int sem_id) {
 }
 
 
+//***************************************************************************//
+// FUTEX SEMAPHORES
+//***************************************************************************//
+
+// One semaphore of a set (alone on its cache line)
+struct fsem {
+  _Alignas(64) _Atomic uint32_t value;
+  // number of processes sleeping (or about to) in fsem_down
+  _Atomic uint32_t waiters;
+};
+
+// The sets attached by this process
+static struct {
+  int id;
+  struct fsem *sems;
+} fsem_sets[FSEM_MAX_SETS];
+static int fsem_nb_sets = 0;
+
+// Returns the (attached) semaphores of the set fsem_id
+static struct fsem *fsem_set(int fsem_id) {
+  for (int i = 0; i < fsem_nb_sets; i++) {
+    if (fsem_sets[i].id == fsem_id) {
+      return fsem_sets[i].sems;
+    }
+  }
+  checkCond(fsem_nb_sets == FSEM_MAX_SETS, "Error too many futex semaphore sets");
+  fsem_sets[fsem_nb_sets].id   = fsem_id;
+  fsem_sets[fsem_nb_sets].sems = sshmat(fsem_id);
+  return fsem_sets[fsem_nb_sets++].sems;
+}
+
+static long futex(_Atomic uint32_t *addr, int op, uint32_t val) {
+  return syscall(SYS_futex, (uint32_t *) addr, op, val, NULL, NULL, 0);
+}
+
+int fsem_create(key_t key, int nsems, int perm, int val) {
+  int fsem_id = sshmget(key, nsems * sizeof(struct fsem), IPC_CREAT | perm);
+  struct fsem *sems = fsem_set(fsem_id);
+  for (int i = 0; i < nsems; i++) {
+    atomic_init(&sems[i].value, (uint32_t) val);
+    atomic_init(&sems[i].waiters, 0);
+  }
+  return fsem_id;
+}
+
+int fsem_get(key_t key, int nsems) {
+  int fsem_id = shmget(key, nsems * sizeof(struct fsem), 0);
+  checkNeg(fsem_id, "Error shmget in fsem_get");
+  return fsem_id;
+}
+
+void fsem_down(int fsem_id, int sem_num) {
+  struct fsem *sem = &fsem_set(fsem_id)[sem_num];
+  for (;;) {
+    // fast path: take a token without any system call
+    uint32_t val = atomic_load(&sem->value);
+    while (val > 0) {
+      if (atomic_compare_exchange_weak(&sem->value, &val, val - 1)) {
+        return;
+      }
+    }
+    // slow path: sleep as long as the value is 0 (fsem_up sees the waiter
+    // or the kernel sees the new value, cf. man 2 futex)
+    atomic_fetch_add(&sem->waiters, 1);
+    long rc = futex(&sem->value, FUTEX_WAIT, 0);
+    atomic_fetch_sub(&sem->waiters, 1);
+    checkCond(rc == -1 && errno != EAGAIN && errno != EINTR, "Error futex wait in fsem_down");
+  }
+}
+
+void fsem_down0(int fsem_id) {
+  fsem_down(fsem_id, 0);
+}
+
+void fsem_up(int fsem_id, int sem_num) {
+  struct fsem *sem = &fsem_set(fsem_id)[sem_num];
+  atomic_fetch_add(&sem->value, 1);
+  if (atomic_load(&sem->waiters) > 0) {
+    long rc = futex(&sem->value, FUTEX_WAKE, 1);
+    checkNeg(rc, "Error futex wake in fsem_up");
+  }
+}
+
+void fsem_up0(int fsem_id) {
+  fsem_up(fsem_id, 0);
+}
+
+void fsem_delete(int fsem_id) {
+  for (int i = 0; i < fsem_nb_sets; i++) {
+    if (fsem_sets[i].id == fsem_id) {
+      sshmdt(fsem_sets[i].sems);
+      fsem_sets[i] = fsem_sets[--fsem_nb_sets];
+      break;
+    }
+  }
+  sshmdelete(fsem_id);
+}
+
+
 //***************************************************************************//
 // SOCKETS SYSCALLS
 //***************************************************************************//
@@ -600,13 +801,20 @@ int spoll(struct pollfd *fds, nfds_t nfds, int timeout){
 }
 
 int get_readable (const int* fds, const bool* fds_invalid, int nb) {
-
-  struct pollfd* pollfds = calloc(nb, sizeof(struct pollfd));
-  checkNull(pollfds, "Error: malloc in function get_readable()");
+  // the pollfd array is kept from one call to the next: it is only
+  // reallocated when it has to grow.
+  static struct pollfd* pollfds = NULL;
+  static int capacity = 0;
+  if (nb > capacity) {
+    pollfds = realloc(pollfds, nb * sizeof(struct pollfd));
+    checkNull(pollfds, "Error: realloc in function get_readable()");
+    capacity = nb;
+  }
 
   for (int i=0; i<nb; i++) {
     pollfds[i].fd = fds[i];
     pollfds[i].events = POLLIN;
+    pollfds[i].revents = 0;
   }
 
   int res = spoll(pollfds, nb, 10);
@@ -622,8 +830,249 @@ int get_readable (const int* fds, const bool* fds_invalid, int nb) {
     }
   }
 
-  free(pollfds);
-
   return readable_index;
 }
 
+//***************************************************************************//
+// EVENT LOOP (EPOLL)
+//***************************************************************************//
+
+struct EventLoop* evloop_create(int max_events) {
+  struct EventLoop* loop = smalloc(sizeof(struct EventLoop));
+  loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+  checkNeg(loop->epfd, "Error epoll_create1");
+  loop->max_events = max_events;
+  loop->nb_fds     = 0;
+  loop->events     = smalloc(max_events * sizeof(struct epoll_event));
+  return loop;
+}
+
+void evloop_add(struct EventLoop* loop, int fd) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events  = EPOLLIN;
+  ev.data.fd = fd;
+  int r = epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev);
+  checkNeg(r, "Error epoll_ctl ADD");
+  loop->nb_fds++;
+}
+
+void evloop_del(struct EventLoop* loop, int fd) {
+  int r = epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+  checkNeg(r, "Error epoll_ctl DEL");
+  loop->nb_fds--;
+}
+
+int evloop_wait(struct EventLoop* loop, int* ready, int timeout) {
+  int n = epoll_wait(loop->epfd, loop->events, loop->max_events, timeout);
+  if (n < 0 && errno == EINTR) {
+    return 0;
+  }
+  checkNeg(n, "Error epoll_wait");
+
+  for (int i = 0; i < n; i++) {
+    ready[i] = loop->events[i].data.fd;
+  }
+  return n;
+}
+
+void evloop_free(struct EventLoop* loop) {
+  sclose(loop->epfd);
+  free(loop->events);
+  free(loop);
+}
+
+//***************************************************************************//
+// BROADCAST TO SOCKETS (ZERO-COPY FAN-OUT)
+//***************************************************************************//
+
+struct SharedBuffer* shbuf_create(const void* data, size_t len) {
+  struct SharedBuffer* sb = smalloc(sizeof(struct SharedBuffer) + len);
+  sb->refcount = 1;
+  sb->length   = len;
+  memcpy(sb->data, data, len);
+  return sb;
+}
+
+void shbuf_retain(struct SharedBuffer* sb) {
+  sb->refcount++;
+}
+
+void shbuf_release(struct SharedBuffer* sb) {
+  if (--sb->refcount == 0) {
+    free(sb);
+  }
+}
+
+struct Broadcaster* bcast_create(int max_subscribers, size_t max_backlog, enum SlowConsumerPolicy policy) {
+  checkCond(max_subscribers <= 0, "Error: a broadcaster needs at least one subscriber slot");
+  struct Broadcaster* bc = smalloc(sizeof(struct Broadcaster));
+  bc->subs            = smalloc(max_subscribers * sizeof(struct Subscriber));
+  bc->max_subscribers = max_subscribers;
+  bc->nb_subscribers  = 0;
+  bc->max_backlog     = max_backlog;
+  bc->policy          = policy;
+  bc->nb_syscalls     = 0;
+  bc->nb_dropped      = 0;
+  bc->nb_disconnected = 0;
+  return bc;
+}
+
+// Discards all the buffers queued for the subscriber.
+static void bcast_clear(struct Subscriber* sub) {
+  for (int i = 0; i < sub->count; i++) {
+    shbuf_release(sub->queue[(sub->head + i) % BCAST_MAX_QUEUE]);
+  }
+  sub->head    = 0;
+  sub->count   = 0;
+  sub->offset  = 0;
+  sub->backlog = 0;
+}
+
+// Marks the subscriber as disconnected (it will be returned by bcast_reap).
+static void bcast_disconnect(struct Broadcaster* bc, struct Subscriber* sub) {
+  if (!sub->disconnected) {
+    sub->disconnected = true;
+    bc->nb_disconnected++;
+  }
+  bcast_clear(sub);
+}
+
+void bcast_subscribe(struct Broadcaster* bc, int fd) {
+  checkCond(bc->nb_subscribers >= bc->max_subscribers, "Error: too many subscribers");
+  int flags = fcntl(fd, F_GETFL);
+  checkNeg(flags, "Error fcntl F_GETFL");
+  checkNeg(fcntl(fd, F_SETFL, flags | O_NONBLOCK), "Error fcntl F_SETFL");
+
+  struct Subscriber* sub = &bc->subs[bc->nb_subscribers++];
+  sub->fd           = fd;
+  sub->disconnected = false;
+  sub->head         = 0;
+  sub->count        = 0;
+  sub->offset       = 0;
+  sub->backlog      = 0;
+}
+
+void bcast_unsubscribe(struct Broadcaster* bc, int fd) {
+  for (int i = 0; i < bc->nb_subscribers; i++) {
+    if (bc->subs[i].fd == fd) {
+      bcast_clear(&bc->subs[i]);
+      bc->subs[i] = bc->subs[--bc->nb_subscribers];
+      return;
+    }
+  }
+}
+
+// Writes as much of the subscriber's backlog as possible without blocking.
+static void bcast_send(struct Broadcaster* bc, struct Subscriber* sub) {
+  while (sub->count > 0 && !sub->disconnected) {
+    // all the queued buffers are sent with a single vectored write
+    struct iovec iov[BCAST_MAX_QUEUE];
+    for (int i = 0; i < sub->count; i++) {
+      struct SharedBuffer* sb = sub->queue[(sub->head + i) % BCAST_MAX_QUEUE];
+      size_t skip = i == 0 ? sub->offset : 0;
+      iov[i].iov_base = sb->data + skip;
+      iov[i].iov_len  = sb->length - skip;
+    }
+    // sendmsg (rather than writev) so that a closed socket gives EPIPE 
+    // instead of killing the process with SIGPIPE
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = sub->count;
+    ssize_t n = sendmsg(sub->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && errno == ENOTSOCK) {
+      n = writev(sub->fd, iov, sub->count);
+    }
+    bc->nb_syscalls++;
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      // broken or closed connection
+      bcast_disconnect(bc, sub);
+      return;
+    }
+
+    // releases the buffers that have been completely sent
+    size_t sent = (size_t) n;
+    sub->backlog -= sent;
+    while (sent > 0) {
+      struct SharedBuffer* sb = sub->queue[sub->head];
+      size_t left = sb->length - sub->offset;
+      if (sent < left) {
+        sub->offset += sent;
+        return;
+      }
+      sent -= left;
+      shbuf_release(sb);
+      sub->head   = (sub->head + 1) % BCAST_MAX_QUEUE;
+      sub->count--;
+      sub->offset = 0;
+    }
+  }
+}
+
+void bcast_publish(struct Broadcaster* bc, const void* data, size_t len) {
+  if (len == 0 || bc->nb_subscribers == 0) {
+    return;
+  }
+
+  // the data is copied once, whatever the number of subscribers
+  struct SharedBuffer* sb = shbuf_create(data, len);
+  for (int i = 0; i < bc->nb_subscribers; i++) {
+    struct Subscriber* sub = &bc->subs[i];
+    if (sub->disconnected) {
+      continue;
+    }
+    if (sub->count == BCAST_MAX_QUEUE || sub->backlog + len > bc->max_backlog) {
+      // slow consumer: it never stalls the others
+      if (bc->policy == BCAST_DROP) {
+        bc->nb_dropped++;
+      } else {
+        bcast_disconnect(bc, sub);
+      }
+      continue;
+    }
+    shbuf_retain(sb);
+    sub->queue[(sub->head + sub->count) % BCAST_MAX_QUEUE] = sb;
+    sub->count++;
+    sub->backlog += len;
+    bcast_send(bc, sub);
+  }
+  shbuf_release(sb);
+}
+
+size_t bcast_flush(struct Broadcaster* bc) {
+  size_t pending = 0;
+  for (int i = 0; i < bc->nb_subscribers; i++) {
+    bcast_send(bc, &bc->subs[i]);
+    pending += bc->subs[i].backlog;
+  }
+  return pending;
+}
+
+int bcast_reap(struct Broadcaster* bc, int* fds, int max) {
+  int n = 0;
+  int i = 0;
+  while (i < bc->nb_subscribers && n < max) {
+    if (bc->subs[i].disconnected) {
+      fds[n++] = bc->subs[i].fd;
+      bc->subs[i] = bc->subs[--bc->nb_subscribers];
+    } else {
+      i++;
+    }
+  }
+  return n;
+}
+
+void bcast_free(struct Broadcaster* bc) {
+  for (int i = 0; i < bc->nb_subscribers; i++) {
+    bcast_clear(&bc->subs[i]);
+  }
+  free(bc->subs);
+  free(bc);
+}
@@ -14,6 +14,7 @@
 #include <stdbool.h>
 #include <signal.h>
 #include <sys/ipc.h>
+#include <sys/epoll.h>
 #include <poll.h>
 
 
@@ -179,6 +180,86 @@ void nwrite(int fd, const void* buf, size_t count);
  */
 char **readFileToTable(int fd);
 
+/** 
+ * Reads a whole file in memory
+ * PRE: fd: is a file descriptor for a file opened in read mode
+ *      len: pointer to a size_t
+ * POST: the content of the file (from the current offset up to EOF) has been
+ *       copied in a dynamically allocated buffer, followed by a '\0'.
+ *       *len contains the number of bytes that have been read.
+ *       When fd refers to a regular file, a single "read" system call is
+ *       usually enough.
+ * RES: the buffer, which must be freed by the calling program
+ */
+char *readFileToBuffer(int fd, size_t *len);
+
+
+//***************************************************************************//
+// BUFFERED WRITES
+//***************************************************************************//
+
+/**
+ * A WriteBuffer accumulates small writes in a contiguous memory area and
+ * sends them to "fd" all at once, so that N small messages cost one "write"
+ * system call instead of N.
+ * The field "nb_syscalls" counts the "write" system calls performed so far.
+ */
+struct WriteBuffer {
+  int    fd;
+  char*  data;
+  size_t capacity;
+  size_t length;
+  size_t nb_syscalls;
+};
+
+/**
+ * PRE:  wb: a WriteBuffer that has not been initialised yet
+ *       fd: a file descriptor on which something can be written
+ *       capacity: an integer > 0
+ * POST: wb is empty and will write its content on fd once it holds
+ *       "capacity" bytes or when it is explicitly flushed.
+ */
+void wbuf_init(struct WriteBuffer* wb, int fd, size_t capacity);
+
+/**
+ * PRE:  wb: an initialised WriteBuffer
+ *       buf: points to a memory segment of at least "count" bytes
+ * POST: the "count" bytes of buf have been appended to wb. If wb did not have
+ *       enough room left, its previous content has been flushed first.
+ *       If "count" exceeds the capacity of wb, the bytes are directly written.
+ */
+void wbuf_write(struct WriteBuffer* wb, const void* buf, size_t count);
+
+/**
+ * PRE:  wb: an initialised WriteBuffer
+ *       buf: points to a memory segment of at least "count" bytes
+ * POST: the content of wb has been flushed, then the "count" bytes of buf
+ *       have been written on wb->fd straight from buf (without any copy).
+ */
+void wbuf_write_direct(struct WriteBuffer* wb, const void* buf, size_t count);
+
+/**
+ * PRE:  wb: an initialised WriteBuffer
+ * POST: the whole content of wb has been written on wb->fd and wb is empty.
+ * RES:  the number of "write" system calls that were needed
+ */
+size_t wbuf_flush(struct WriteBuffer* wb);
+
+/**
+ * PRE:  wb: an initialised WriteBuffer
+ *       fds: an array of "nb_fds" file descriptors on which something can be written
+ * POST: the whole content of wb has been written on each of the fds (instead
+ *       of wb->fd) and wb is empty.
+ * RES:  the number of "write" system calls that were needed
+ */
+size_t wbuf_flush_to(struct WriteBuffer* wb, const int* fds, size_t nb_fds);
+
+/**
+ * PRE:  wb: an initialised WriteBuffer
+ * POST: the memory held by wb is released. Its content is NOT flushed.
+ */
+void wbuf_free(struct WriteBuffer* wb);
+
 
 //***************************************************************************//
 // FORK SYSCALL
@@ -371,6 +452,71 @@ void sem_up0(int sem_id);
 void sem_delete(int sem_id);
 
 
+//***************************************************************************//
+// FUTEX SEMAPHORES
+//***************************************************************************//
+
+// Same API as the SysV semaphores above, but the semaphores are counters
+// placed in a shared memory segment and updated with atomic operations:
+// fsem_down and fsem_up only make a system call (futex) when a process
+// actually has to sleep or to be woken up. When the semaphore is not
+// contended, they stay entirely in user space.
+//
+// NOTE: The segment is attached (once per process) by the first fsem_*
+//       call made with its id; a process created by fork afterwards inherits
+//       the attachment. At most FSEM_MAX_SETS sets can be used at once by a
+//       process, and these functions must not be called by several threads
+//       of the same process at the same time (Linux only).
+
+#define FSEM_MAX_SETS 16
+
+/** 
+ * PRE:  key: semaphore identification key
+ *       nsems: number of semaphores to create
+ *       perm: permissions to access semaphores
+ *       val: value to initialize semaphores
+ * POST: creates a new set of futex semaphores associated with key,
+ *      with permissions perm, initializes their values to val 
+ *      and returns the semaphore set identifier.
+ */
+int fsem_create(key_t key, int nsems, int perm, int val);
+
+/** 
+ * PRE:  key: identification key of an existing set of futex semaphores
+ *      nsems: number of semaphores 
+ * POST: returns the semaphore set identifier associated with key
+ */
+int fsem_get(key_t key, int nsems);
+
+/** 
+ * PRE:  fsem_id: identification number of a set of futex semaphores
+ *       sem_num: semaphore number
+ * POST: decrements the sem_num'th semaphore of the set
+ *       (sleeps as long as its value is 0)
+ */
+void fsem_down(int fsem_id, int sem_num);
+
+// idem fsem_down() with sem_num = 0
+void fsem_down0(int fsem_id);
+
+/** 
+ * PRE:  fsem_id: identification number of a set of futex semaphores
+ *       sem_num: semaphore number
+ * POST: increments the sem_num'th semaphore of the set
+ *       (and wakes up a process waiting for it, if any)
+ */
+void fsem_up(int fsem_id, int sem_num);
+
+// idem fsem_up() with sem_num = 0
+void fsem_up0(int fsem_id);
+
+/** 
+ * PRE:  fsem_id: identification number of a set of futex semaphores
+ * POST: removes the semaphore set
+ */
+void fsem_delete(int fsem_id);
+
+
 //***************************************************************************//
 // SOCKETS SYSCALLS
 //***************************************************************************//
@@ -458,4 +604,207 @@ int spoll(struct pollfd *fds, nfds_t nfds, int timeout);
  */
 int get_readable (const int* fds, const bool* fds_invalid, int nb);
 
+
+//***************************************************************************//
+// EVENT LOOP (EPOLL)
+//***************************************************************************//
+
+/**
+ * An EventLoop watches a set of file descriptors with epoll. Unlike
+ * get_readable, the set of watched fds is registered once (and not rebuilt
+ * upon each call), the caller chooses the timeout and all the fds that are
+ * ready are reported at once.
+ */
+struct EventLoop {
+  int epfd;
+  int max_events;
+  int nb_fds;
+  struct epoll_event* events;
+};
+
+/**
+ * PRE:  max_events: an integer > 0
+ * POST: an empty event loop has been created. Each call to evloop_wait
+ *       reports at most "max_events" ready fds (the others are reported
+ *       by the next calls).
+ * RES:  the event loop, which must be released with evloop_free
+ */
+struct EventLoop* evloop_create(int max_events);
+
+/**
+ * PRE:  loop: an event loop created with evloop_create
+ *       fd: a valid file descriptor which is not yet watched by loop
+ * POST: loop watches fd: evloop_wait reports it whenever data can be read
+ *       from it (or when the peer has closed the connection).
+ */
+void evloop_add(struct EventLoop* loop, int fd);
+
+/**
+ * PRE:  loop: an event loop created with evloop_create
+ *       fd: a file descriptor watched by loop
+ * POST: loop does not watch fd anymore. 
+ *       NOTE: this must be done BEFORE fd gets closed.
+ */
+void evloop_del(struct EventLoop* loop, int fd);
+
+/**
+ * PRE:  loop: an event loop created with evloop_create
+ *       ready: an array of at least loop->max_events integers
+ *       timeout: the maximum number of milliseconds to wait 
+ *       (-1: wait forever, 0: do not wait at all)
+ * POST: blocks until at least one of the watched fds is ready, the timeout
+ *       expires or the call is interrupted by a signal handler.
+ * RES:  the number n of ready fds, which are stored in ready[0..n-1];
+ *       0 if the timeout expired or if a signal was caught.
+ */
+int evloop_wait(struct EventLoop* loop, int* ready, int timeout);
+
+/**
+ * PRE:  loop: an event loop created with evloop_create
+ * POST: the resources held by loop have been released (the watched fds 
+ *       are NOT closed).
+ */
+void evloop_free(struct EventLoop* loop);
+
+//***************************************************************************//
+// BROADCAST TO SOCKETS (ZERO-COPY FAN-OUT)
+//***************************************************************************//
+
+/**
+ * A SharedBuffer holds bytes that are sent to several sockets. It is 
+ * reference counted: each subscriber that still has to send it holds a
+ * reference, and the buffer is freed when the last reference is released.
+ */
+struct SharedBuffer {
+  int refcount;
+  size_t length;
+  char data[];
+};
+
+/**
+ * PRE:  data: a buffer of len bytes
+ * POST: a SharedBuffer holding a copy of data has been created. Its
+ *       refcount is 1 (the reference of the caller).
+ * RES:  the SharedBuffer
+ */
+struct SharedBuffer* shbuf_create(const void* data, size_t len);
+
+/**
+ * PRE:  sb: a SharedBuffer
+ * POST: the refcount of sb has been incremented
+ */
+void shbuf_retain(struct SharedBuffer* sb);
+
+/**
+ * PRE:  sb: a SharedBuffer
+ * POST: the refcount of sb has been decremented, and sb has been freed
+ *       if it reached 0.
+ */
+void shbuf_release(struct SharedBuffer* sb);
+
+/**
+ * What a Broadcaster does with a subscriber which does not read fast 
+ * enough (its backlog would exceed the limit):
+ * - BCAST_DROP: the new data is not sent to this subscriber.
+ * - BCAST_DISCONNECT: the subscriber is removed (cf. bcast_reap).
+ */
+enum SlowConsumerPolicy {
+  BCAST_DROP       = 0,
+  BCAST_DISCONNECT = 1
+};
+
+// The maximum number of SharedBuffers waiting to be sent to a subscriber.
+#define BCAST_MAX_QUEUE 64
+
+/**
+ * A subscriber of a Broadcaster: the buffers it still has to receive.
+ */
+struct Subscriber {
+  int fd;
+  bool disconnected;
+  // ring of the SharedBuffers to send (the first one partially sent)
+  struct SharedBuffer* queue[BCAST_MAX_QUEUE];
+  int head, count;
+  // number of bytes of the first buffer already sent
+  size_t offset;
+  // number of bytes still to send
+  size_t backlog;
+};
+
+/**
+ * A Broadcaster sends the same bytes to many sockets. Each published buffer 
+ * is copied once (into a SharedBuffer) and written to all the subscribers 
+ * with non-blocking vectored writes, straight from the SharedBuffer. A 
+ * subscriber which cannot keep up accumulates a backlog, which is bounded:
+ * the game loop never waits for a slow consumer.
+ */
+struct Broadcaster {
+  struct Subscriber* subs;
+  int max_subscribers;
+  int nb_subscribers;
+  size_t max_backlog;
+  enum SlowConsumerPolicy policy;
+  // statistics
+  size_t nb_syscalls;
+  size_t nb_dropped;
+  size_t nb_disconnected;
+};
+
+/**
+ * PRE:  max_subscribers > 0
+ *       max_backlog: the maximum number of bytes waiting to be sent to a
+ *       subscriber
+ *       policy: what to do with slow subscribers
+ * RES:  a Broadcaster without subscribers, which must be released with
+ *       bcast_free
+ */
+struct Broadcaster* bcast_create(int max_subscribers, size_t max_backlog, enum SlowConsumerPolicy policy);
+
+/**
+ * PRE:  bc: a Broadcaster which has less than max_subscribers subscribers
+ *       fd: a connected socket (or a pipe)
+ * POST: fd has been put in non-blocking mode and receives all the buffers
+ *       published from now on.
+ */
+void bcast_subscribe(struct Broadcaster* bc, int fd);
+
+/**
+ * PRE:  bc: a Broadcaster, fd: one of its subscribers
+ * POST: fd does not receive anything anymore (what was not sent yet is 
+ *       discarded). fd is NOT closed.
+ */
+void bcast_unsubscribe(struct Broadcaster* bc, int fd);
+
+/**
+ * PRE:  bc: a Broadcaster, data: a buffer of len bytes
+ * POST: data has been queued for each subscriber, and as much as possible
+ *       has been written without blocking. Slow subscribers have been 
+ *       handled according to bc->policy.
+ */
+void bcast_publish(struct Broadcaster* bc, const void* data, size_t len);
+
+/**
+ * PRE:  bc: a Broadcaster
+ * POST: the pending data of each subscriber has been written as far as
+ *       possible without blocking (e.g. when a socket becomes writable).
+ * RES:  the number of bytes still pending (for all subscribers)
+ */
+size_t bcast_flush(struct Broadcaster* bc);
+
+/**
+ * PRE:  bc: a Broadcaster, fds: an array of at least max elements
+ * POST: the subscribers that have been disconnected (slow consumers, 
+ *       closed or broken sockets) are removed from bc and stored in fds.
+ *       The caller has to close them.
+ * RES:  the number of fds stored in fds
+ */
+int bcast_reap(struct Broadcaster* bc, int* fds, int max);
+
+/**
+ * PRE:  bc: a Broadcaster
+ * POST: the resources held by bc have been released (the subscribed fds 
+ *       are NOT closed).
+ */
+void bcast_free(struct Broadcaster* bc);
+
 #endif  // _UTILS_H_